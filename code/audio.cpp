@@ -2,236 +2,435 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
-#include <mmdeviceapi.h>
-#include <endpointvolume.h>
-#include <functiondiscoverykeys_devpkey.h>
-#include "PolicyConfig.h"
+#include <math.h>
+#include <signal.h>
+#include "audio_platform.h"
+#include "audio_patterns.h"
+#include "audio_levels.h"
 
 struct DeviceInfo {
-	LPWSTR Id;
-	LPWSTR Name;
+	StringId Id;
+	StringId Name;
 
 	// Volume
 	float VolumeScalar;
 	float VolumeLevel;
 	BOOL IsMute;
 
+	// Volume and mute were read from the endpoint, so writes that match
+	// them can be skipped
+	bool HasVolume;
+
 	// Device flags
 	EDataFlow DataFlow;
-	BOOL IsDefaultPlayback;
-	BOOL IsDefaultCommunicationPlayback;
-	BOOL IsDefaultRecording;
-	BOOL IsDefaultCommunicationRecording;
 	DWORD State;
 };
 
+// DeviceDetails.Bus
+enum DeviceBus {
+	Bus_Unknown,
+	Bus_Internal,
+	Bus_Usb,
+	Bus_Bluetooth,
+	Bus_Virtual,
+	Bus_Count
+};
+
+#define DETAILS_PROPERTIES 0x1
+#define DETAILS_FORMAT 0x2
+#define DETAILS_FLOAT 0x4
+
+// Extended endpoint metadata, read on demand. Only Stamp and the property
+// store fields are read every time, the rest is cached in DETAILS_PATH.
+struct DeviceDetails {
+	// Shared mode mix format
+	DWORD SampleRate;
+	WORD Channels;
+	WORD BitsPerSample;
+
+	// Audio engine periods in 100 ns units
+	LONGLONG DefaultPeriod;
+	LONGLONG MinimumPeriod;
+
+	DWORD Stamp;
+	BYTE FormFactor;
+	BYTE Bus;
+	BYTE Flags;
+};
+
 struct Device{
 	DeviceInfo Info;
+	DeviceDetails Details;
+	PlatformDevice Platform;
+};
 
-	IMMDevice* Device;
-	IPropertyStore* PropertyStore;
-	IAudioEndpointVolume* AudioEndpointVolume;
-	IMMEndpoint* Endpoint;
+// Default device for each role and flow, as an index into AllDevices.
+// Entries are resolved lazily, at most once per refresh, and are marked
+// stale again when the backend reports a default device change.
+struct DefaultRoleTable {
+	StringId Ids[ERole_enum_count][2];
+	int Devices[ERole_enum_count][2];
+	volatile LONG Stale;
 };
 
-struct DefaultDevices {
-	LPWSTR Playback;
-	LPWSTR CommunicationPlayback;
+#define DEFAULT_ROLE_BIT(role, dataFlow) (1 << ((role) * 2 + (dataFlow)))
+#define DEFAULT_ROLE_ALL ((1 << (ERole_enum_count * 2)) - 1)
 
-	LPWSTR Recording;
-	LPWSTR CommunicationRecording;
-};
+static DefaultRoleTable Defaults;
 
 static UINT NumDevices;
+static UINT DeviceCapacity;
 static Device* AllDevices;
 
-IMMDeviceEnumerator* DeviceEnumerator;
-IPolicyConfig* PolicyConfig;
+// Incremented on every refresh, invalidates anything holding device indices
+static UINT DeviceGeneration;
 
-static void PopulateInfo(Device* device, DefaultDevices* defaultDevices)
-{
-	device->Device->GetId(&device->Info.Id);
-	device->Device->GetState(&device->Info.State);
+// AllDevices index for each interned string, or -1 if it is not a device Id
+static int* DeviceIndexByString;
+static UINT DeviceIndexCapacity;
 
-	PROPVARIANT varProperty;
-	device->PropertyStore->GetValue(PKEY_Device_FriendlyName, &varProperty);
-	device->Info.Name = varProperty.pwszVal;
+// First AllDevices index with each name, devices sharing a name are chained
+// through NextDeviceWithName
+static int* DeviceIndexByName;
+static int* NextDeviceWithName;
 
-	device->Endpoint->GetDataFlow(&device->Info.DataFlow);
+static LONGLONG TimerFrequency;
 
-	if (device->Info.State == DEVICE_STATE_ACTIVE)
+static LONGLONG GetTimestamp(void)
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+static double MillisecondsSince(LONGLONG start)
+{
+	if (TimerFrequency == 0)
 	{
-		device->AudioEndpointVolume->GetMasterVolumeLevelScalar(&device->Info.VolumeScalar);
-		device->AudioEndpointVolume->GetMasterVolumeLevel(&device->Info.VolumeLevel);
-		device->AudioEndpointVolume->GetMute(&device->Info.IsMute);
-
-		if (lstrcmpW(device->Info.Id, defaultDevices->Playback) == 0)
-			device->Info.IsDefaultPlayback = TRUE;
-		if (lstrcmpW(device->Info.Id, defaultDevices->CommunicationPlayback) == 0)
-			device->Info.IsDefaultCommunicationPlayback = TRUE;
-
-		if (lstrcmpW(device->Info.Id, defaultDevices->Recording) == 0)
-			device->Info.IsDefaultRecording = TRUE;
-		if (lstrcmpW(device->Info.Id, defaultDevices->CommunicationRecording) == 0)
-			device->Info.IsDefaultCommunicationRecording = TRUE;
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		TimerFrequency = frequency.QuadPart;
 	}
+
+	return (double)(GetTimestamp() - start) * 1000.0 / (double)TimerFrequency;
 }
 
-static void GetDefaultDevices(DefaultDevices* defaultDevices)
+#include "audio_metrics.cpp"
+
+#ifdef _WIN32
+#include "win32_audio.cpp"
+#else
+#include "linux_audio.cpp"
+#endif
+
+static int FindDeviceIndex(StringId id)
 {
-	IMMDevice* device;
+	if (id == STRING_ID_NONE || id >= DeviceIndexCapacity)
+		return -1;
+	return DeviceIndexByString[id];
+}
 
-	if (SUCCEEDED(DeviceEnumerator->GetDefaultAudioEndpoint(EDataFlow::eRender, ERole::eMultimedia, &device))) {
-		device->GetId(&defaultDevices->Playback);
-	}
-	else {
-		printf("No Default Playback Device\n");
+static void IndexAllDevices(void)
+{
+	if (Strings.NumEntries > DeviceIndexCapacity)
+	{
+		ArenaFree(DeviceIndexByString);
+		ArenaFree(DeviceIndexByName);
+		DeviceIndexCapacity = Strings.EntryCapacity;
+		DeviceIndexByString = (int*)ArenaAlloc(DeviceIndexCapacity * sizeof(int));
+		DeviceIndexByName = (int*)ArenaAlloc(DeviceIndexCapacity * sizeof(int));
 	}
 
-	if (SUCCEEDED(DeviceEnumerator->GetDefaultAudioEndpoint(EDataFlow::eRender, ERole::eCommunications, &device))) {
-		device->GetId(&defaultDevices->CommunicationPlayback);
-	}
-	else {
-		printf("No Default Playback Communication Device\n");
-	}
+	memset(DeviceIndexByString, 0xFF, DeviceIndexCapacity * sizeof(int));
+	memset(DeviceIndexByName, 0xFF, DeviceIndexCapacity * sizeof(int));
 
-	if (SUCCEEDED(DeviceEnumerator->GetDefaultAudioEndpoint(EDataFlow::eCapture, ERole::eMultimedia, &device))) {
-		device->GetId(&defaultDevices->Recording);
-	}
-	else {
-		printf("No Default Recording Device\n");
-	}
+	// Backwards so each chain is in enumeration order
+	for (int i = NumDevices - 1; i >= 0; i--)
+	{
+		DeviceInfo* info = &AllDevices[i].Info;
 
-	if (SUCCEEDED(DeviceEnumerator->GetDefaultAudioEndpoint(EDataFlow::eCapture, ERole::eCommunications, &device))) {
-		device->GetId(&defaultDevices->CommunicationRecording);
-	}
-	else {
-		printf("No Default Recording Communication Device\n");
+		if (info->Id != STRING_ID_NONE)
+			DeviceIndexByString[info->Id] = i;
+
+		NextDeviceWithName[i] = -1;
+		if (info->Name != STRING_ID_NONE)
+		{
+			NextDeviceWithName[i] = DeviceIndexByName[info->Name];
+			DeviceIndexByName[info->Name] = i;
+		}
 	}
+}
+
+static int FindDeviceIndexByName(StringId name)
+{
+	if (name == STRING_ID_NONE || name >= DeviceIndexCapacity)
+		return -1;
+	return DeviceIndexByName[name];
+}
+
+#include "audio_trace.cpp"
+
+static void ResolveDefaultDevice(ERole role, EDataFlow dataFlow)
+{
+	Defaults.Ids[role][dataFlow] = STRING_ID_NONE;
+	Defaults.Devices[role][dataFlow] = -1;
+
+	StringId defaultId = EndpointGetDefault(role, dataFlow);
+	int index = FindDeviceIndex(defaultId);
+	if (index < 0)
+		return;
 
-	printf("\n");
+	Defaults.Ids[role][dataFlow] = defaultId;
+	Defaults.Devices[role][dataFlow] = index;
 }
 
-static void PopulateAllDevices(void)
+static int GetDefaultDeviceIndex(ERole role, EDataFlow dataFlow)
 {
-	DefaultDevices defaultDevices;
-	GetDefaultDevices(&defaultDevices);
+	LONG bit = DEFAULT_ROLE_BIT(role, dataFlow);
 
-	for (int i = 0; i < NumDevices; i++)
+	if (Defaults.Stale & bit)
 	{
-		PopulateInfo(&AllDevices[i], &defaultDevices);
+		// Clear first so a change reported while resolving is not lost
+		InterlockedAnd(&Defaults.Stale, ~bit);
+		ResolveDefaultDevice(role, dataFlow);
 	}
+
+	return Defaults.Devices[role][dataFlow];
 }
 
-static void InitializeAndPopulateAllDevices(void)
+static bool IsDefaultDevice(StringId id, ERole role, EDataFlow dataFlow)
+{
+	int index = GetDefaultDeviceIndex(role, dataFlow);
+	return index >= 0 && Defaults.Ids[role][dataFlow] == id;
+}
+
+static void SetDefaultDeviceIndex(ERole role, EDataFlow dataFlow, int index)
+{
+	Defaults.Ids[role][dataFlow] = AllDevices[index].Info.Id;
+	Defaults.Devices[role][dataFlow] = index;
+}
+
+#include "audio_commands.cpp"
+#include "audio_switch.cpp"
+
+static void ReleaseDevice(Device* device)
+{
+	device->Info = {};
+	device->Details = {};
+	PlatformReleaseDevice(device);
+}
+
+static void ReleaseAllDevices(void)
 {
-	int MaxDevices = 256;
+	for (int i = 0; i < NumDevices; i++)
+	{
+		ReleaseDevice(&AllDevices[i]);
+	}
+
 	NumDevices = 0;
+}
 
-	if (AllDevices == NULL)
-		AllDevices = (Device*)VirtualAlloc(0, sizeof(Device) * MaxDevices, MEM_COMMIT, PAGE_READWRITE);
+static void GrowDevices(UINT capacity)
+{
+	ArenaFree(AllDevices);
+	ArenaFree(NextDeviceWithName);
 
-	if (DeviceEnumerator == NULL)
-		CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&DeviceEnumerator));
+	// Zeroed pages are valid empty handles, so no constructors need to run.
+	DeviceCapacity = capacity;
+	AllDevices = (Device*)ArenaAlloc(DeviceCapacity * sizeof(Device));
+	NextDeviceWithName = (int*)ArenaAlloc(DeviceCapacity * sizeof(int));
+}
 
-	if (PolicyConfig == NULL)
-		CoCreateInstance(__uuidof(CPolicyConfigClient), NULL, CLSCTX_ALL, __uuidof(IPolicyConfig), (LPVOID*)&PolicyConfig);
+static void InitializeAndPopulateAllDevices(void)
+{
+	// Pending writes hold device indices
+	FlushCommands();
+	ReleaseAllDevices();
+	ResetStrings();
+	DeviceGeneration++;
 
-	IMMDeviceCollection* deviceCollectionPtr = NULL;
-	DeviceEnumerator->EnumAudioEndpoints(eAll, DEVICE_STATE_ACTIVE | DEVICE_STATE_DISABLED | DEVICE_STATE_UNPLUGGED, &deviceCollectionPtr);
+	if (AllDevices == NULL)
+		GrowDevices(64);
 
-	UINT count;
-	deviceCollectionPtr->GetCount(&count);
+	UINT count = EndpointEnumerate(AllDevices, DeviceCapacity);
 
-	if (count > MaxDevices)
+	// More devices than fit, grow and enumerate again. Backends fill
+	// nothing, or only plain data, when they report an overflow.
+	while (count > DeviceCapacity)
 	{
-		printf("Too many devices. Max is %i\n", MaxDevices);
-		return;
+		ResetStrings();
+		GrowDevices(count * 2);
+		count = EndpointEnumerate(AllDevices, DeviceCapacity);
 	}
 
-	Device* currDevice = AllDevices;
-
 	NumDevices = count;
 
-	for (int i = 0; i < count; i++)
-	{
-		deviceCollectionPtr->Item(i, &currDevice->Device);
-		currDevice->Device->OpenPropertyStore(STGM_READ, &currDevice->PropertyStore);
-		currDevice->Device->Activate(__uuidof(IAudioEndpointVolume), CLSCTX_ALL, NULL, (void**)&currDevice->AudioEndpointVolume);
-		currDevice->Device->QueryInterface(__uuidof(IMMEndpoint), (void**)&currDevice->Endpoint);
+	IndexAllDevices();
+	InterlockedExchange(&Defaults.Stale, DEFAULT_ROLE_ALL);
+}
+
+static void RefreshAllDevices(int cycles)
+{
+#ifdef _WIN32
+	PrintResourceCounters("Before refresh");
+#endif
 
-		currDevice++;
+	for (int i = 0; i < cycles; i++)
+	{
+		InitializeAndPopulateAllDevices();
 	}
 
-	PopulateAllDevices();
+#ifdef _WIN32
+	PrintResourceCounters("After refresh");
+#endif
 }
 
+// Only the most recent star is ever retried. A later star can absorb
+// anything an earlier one could, so this is at worst pattern × candidate
+// steps instead of exponential backtracking.
 bool match(const wchar_t* pattern, const wchar_t* candidate, int p, int c) {
-	if (pattern[p] == L'\0')
-	{
-		return candidate[c] == L'\0';
-	}
-	else if (pattern[p] == L'*')
+	int starP = -1;
+	int starC = 0;
+
+	while (candidate[c] != L'\0')
 	{
-		for (; candidate[c] != L'\0'; c++)
+		if (pattern[p] == L'*')
 		{
-			if (match(pattern, candidate, p + 1, c))
-				return true;
+			starP = p++;
+			starC = c;
+		}
+		else if (pattern[p] != L'\0' && pattern[p] == candidate[c])
+		{
+			p++;
+			c++;
+		}
+		else if (starP >= 0)
+		{
+			p = starP + 1;
+			c = ++starC;
+		}
+		else
+		{
+			return false;
 		}
-
-		return match(pattern, candidate, p + 1, c);
-	}
-	else if (pattern[p] != candidate[c])
-	{
-		return false;
-	}
-	else
-	{
-		return match(pattern, candidate, p + 1, c + 1);
 	}
+
+	while (pattern[p] == L'*')
+		p++;
+
+	return pattern[p] == L'\0';
 }
 
+// A user supplied pattern, compiled when it is well formed and matched by
+// match() otherwise
+struct NamePattern {
+	const wchar_t* Text;
+	CompiledPattern Compiled;
+	bool IsCompiled;
+};
+
+static NamePattern MakeNamePattern(const wchar_t* pattern)
+{
+	NamePattern result = {};
+	result.Text = pattern;
+	result.IsCompiled = TryCompilePattern(pattern, &result.Compiled);
+	return result;
+}
+
+static bool MatchName(const NamePattern* pattern, StringId name)
+{
+	if (pattern->IsCompiled)
+		return MatchPattern(&pattern->Compiled, name);
+	return match(pattern->Text, StringText(name), 0, 0);
+}
+
+#include "audio_details.cpp"
+
+// Volume and mute only reach devices that are active once shown
+static void SetDevice(Device* device, float volumeScalar, BOOL mute)
+{
+	QueueVisibility(device, true);
+	QueueVolumeScalar(device, volumeScalar);
+	QueueMute(device, mute);
+}
+
+// Matches names, form factors and buses like -details
 static void SetDevicesWhere(float volumeScalar, BOOL mute, const wchar_t* pattern, bool invert)
 {
+	NamePattern namePattern = MakeNamePattern(pattern);
+
+	bool details = MatchesAnyDetails(&namePattern);
+	if (details)
+		ReadAllDetailsProperties();
+
 	for (int i = 0; i < NumDevices; i++)
 	{
 		Device* device = &AllDevices[i];
 
-		bool isMatch = match(pattern, device->Info.Name, 0, 0);
+		bool isMatch = details ? MatchDetails(&namePattern, device) : MatchName(&namePattern, device->Info.Name);
 		if (invert)
 			isMatch = !isMatch;
 
-		if (!isMatch)
-			continue;
+		if (isMatch)
+			SetDevice(device, volumeScalar, mute);
+	}
+}
 
-		PolicyConfig->SetEndpointVisibility(device->Info.Id, true);
-		device->Device->GetState(&device->Info.State);
+// One pass over the devices for several patterns, each device is set once
+static void SetDevicesWhereAny(float volumeScalar, BOOL mute, const CompiledPattern** patterns, int numPatterns)
+{
+	for (int i = 0; i < NumDevices; i++)
+	{
+		Device* device = &AllDevices[i];
 
-		if (device->Info.State == DEVICE_STATE_ACTIVE)
+		for (int p = 0; p < numPatterns; p++)
 		{
-			device->AudioEndpointVolume->SetMasterVolumeLevel(volumeScalar, &GUID_NULL);
-			device->AudioEndpointVolume->SetMasterVolumeLevelScalar(volumeScalar, &GUID_NULL);
-			device->AudioEndpointVolume->SetMute(mute, &GUID_NULL);
+			if (MatchPattern(patterns[p], device->Info.Name))
+			{
+				SetDevice(device, volumeScalar, mute);
+				break;
+			}
 		}
 	}
 }
 
+static void SetDefaultDevice(ERole role, EDataFlow dataFlow, int index)
+{
+	QueueDefault(&AllDevices[index], role);
+}
+
 static bool SetDefaultDevicesWhere(ERole role, EDataFlow dataFlow, const wchar_t* pattern)
 {
-	bool flag = false;
+	NamePattern namePattern = MakeNamePattern(pattern);
+
 	for (int i = 0; i < NumDevices; i++)
 	{
 		Device* device = &AllDevices[i];
 
-		if (!match(pattern, device->Info.Name, 0, 0) || device->Info.DataFlow != dataFlow)
-			continue;
+		if (device->Info.DataFlow == dataFlow && MatchName(&namePattern, device->Info.Name))
+		{
+			SetDefaultDevice(role, dataFlow, i);
+			return true;
+		}
+	}
 
-		PolicyConfig->SetDefaultEndpoint(device->Info.Id, role);
-		flag = true;
-		break;
+	return false;
+}
+
+static bool SetDefaultDevicesWhere(ERole role, EDataFlow dataFlow, const CompiledPattern* pattern)
+{
+	for (int i = 0; i < NumDevices; i++)
+	{
+		Device* device = &AllDevices[i];
+
+		if (device->Info.DataFlow == dataFlow && MatchPattern(pattern, device->Info.Name))
+		{
+			SetDefaultDevice(role, dataFlow, i);
+			return true;
+		}
 	}
 
-	return flag;
+	return false;
 }
 
 static void EnableAllDevices()
@@ -239,7 +438,7 @@ static void EnableAllDevices()
 	for (int i = 0; i < NumDevices; i++)
 	{
 		Device* device = &AllDevices[i];
-		PolicyConfig->SetEndpointVisibility(device->Info.Id, true);
+		QueueVisibility(device, true);
 	}
 }
 
@@ -248,7 +447,7 @@ static void DisableAllDevices()
 	for (int i = 0; i < NumDevices; i++)
 	{
 		Device* device = &AllDevices[i];
-		PolicyConfig->SetEndpointVisibility(device->Info.Id, false);
+		QueueVisibility(device, false);
 	}
 }
 
@@ -272,73 +471,72 @@ static void RandomizeAllDevices()
 
 		if (device->Info.State == DEVICE_STATE_ACTIVE)
 		{
-			device->AudioEndpointVolume->SetMasterVolumeLevelScalar(randomScalar, &GUID_NULL);
-			device->AudioEndpointVolume->SetMute(mute, &GUID_NULL);
+			QueueVolumeScalar(device, randomScalar);
+			QueueMute(device, mute);
 			if (randomDefault < 0.25)
-				SetDefaultDevicesWhere(ERole::eMultimedia, device->Info.DataFlow, device->Info.Name);
+				SetDefaultDevicesWhere(ERole::eMultimedia, device->Info.DataFlow, StringText(device->Info.Name));
 			if (randomDefaultCommunication < 0.25)
-				SetDefaultDevicesWhere(ERole::eCommunications, device->Info.DataFlow, device->Info.Name);
+				SetDefaultDevicesWhere(ERole::eCommunications, device->Info.DataFlow, StringText(device->Info.Name));
 		}
 
-		PolicyConfig->SetEndpointVisibility(device->Info.Id, state);
+		QueueVisibility(device, state);
 	}
 }
 
-static void SetAstroDevices()
+static void SetAstroDevices(FILE* output)
 {
-	wchar_t* astroGame = L"*Astro*Game*";
-	wchar_t* astroVoice = L"*Astro*Voice*";
+	PRESET_PATTERN(astroGame, L"*Astro*Game*");
+	PRESET_PATTERN(astroVoice, L"*Astro*Voice*");
 
-	SetDevicesWhere(1.0, FALSE, astroGame, false);
-	SetDevicesWhere(1.0, FALSE, astroVoice, false);
+	const CompiledPattern* patterns[] = { &astroGame, &astroVoice };
+	SetDevicesWhereAny(1.0, FALSE, patterns, 2);
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, astroGame))
-		printf("Set Astro Default Playback Device\n");
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, &astroGame))
+		fprintf(output, "Set Astro Default Playback Device\n");
 	else
-		printf("Unable to find Astro Playback Device. Did not set Default Playback Device.\n");
+		fprintf(output, "Unable to find Astro Playback Device. Did not set Default Playback Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, astroVoice))
-		printf("Set Astro Default Playback Communication Device\n");
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, &astroVoice))
+		fprintf(output, "Set Astro Default Playback Communication Device\n");
 	else
-		printf("Unable to find Astro Playback Communication Device. Did not set Default Playback Communication Device.\n");
+		fprintf(output, "Unable to find Astro Playback Communication Device. Did not set Default Playback Communication Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, astroVoice))
-		printf("Set Astro Default Recording Device\n");
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, &astroVoice))
+		fprintf(output, "Set Astro Default Recording Device\n");
 	else
-		printf("Unable to find Astro Recording Device. Did not set Default Recording Device.\n");
+		fprintf(output, "Unable to find Astro Recording Device. Did not set Default Recording Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, astroVoice))
-		printf("Set Astro Default Recording Communication Device\n");
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, &astroVoice))
+		fprintf(output, "Set Astro Default Recording Communication Device\n");
 	else
-		printf("Unable to find Astro Recording Communication Device. Did not set Default Recording Communication Device.\n");
+		fprintf(output, "Unable to find Astro Recording Communication Device. Did not set Default Recording Communication Device.\n");
 }
 
 static void SetTCHeliconDevices()
 {
-	wchar_t* TCsystem = L"*System*TC-Helicon*";
-	wchar_t* TCchat = L"*Chat*TC-Helicon*";
-	wchar_t* TCmic = L"*Mic*TC-Helicon*";
+	PRESET_PATTERN(TCsystem, L"*System*TC-Helicon*");
+	PRESET_PATTERN(TCchat, L"*Chat*TC-Helicon*");
+	PRESET_PATTERN(TCmic, L"*Mic*TC-Helicon*");
 
-	SetDevicesWhere(1.0, FALSE, TCsystem, false);
-	SetDevicesWhere(1.0, FALSE, TCchat, false);
-	SetDevicesWhere(1.0, FALSE, TCmic, false);
+	const CompiledPattern* patterns[] = { &TCsystem, &TCchat, &TCmic };
+	SetDevicesWhereAny(1.0, FALSE, patterns, 3);
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, TCsystem))
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, &TCsystem))
 		printf("Set TC-Helicon Default Playback Device\n");
 	else
 		printf("Unable to find TC-Helicon Playback Device. Did not set Default Playback Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, TCchat))
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, &TCchat))
 		printf("Set TC-Helicon Default Playback Communication Device\n");
 	else
 		printf("Unable to find TC-Helicon Playback Communication Device. Did not set Default Playback Communication Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, TCmic))
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, &TCmic))
 		printf("Set TC-Helicon Default Recording Device\n");
 	else
 		printf("Unable to find TC-Helicon Recording Device. Did not set Default Recording Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, TCmic))
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, &TCmic))
 		printf("Set TC-Helicon Default Recording Communication Device\n");
 	else
 		printf("Unable to find TC-Helicon Recording Communication Device. Did not set Default Recording Communication Device.\n");
@@ -348,26 +546,27 @@ static void SetTCHeliconDevices()
 
 static void SetNDIDevices()
 {
-	wchar_t* NDIWebcam = L"*NDI*Webcam*";
+	PRESET_PATTERN(NDIWebcam, L"*NDI*Webcam*");
 
-	SetDevicesWhere(1.0, FALSE, NDIWebcam, false);
+	const CompiledPattern* patterns[] = { &NDIWebcam };
+	SetDevicesWhereAny(1.0, FALSE, patterns, 1);
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, NDIWebcam))
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, &NDIWebcam))
 		printf("Set NDI Webcam as Default Playback Device\n");
 	else
 		printf("Unable to find NDI Webcam Playback Device. Did not set Default Playback Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, NDIWebcam))
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, &NDIWebcam))
 		printf("Set NDI Webcam as Default Playback Communication Device\n");
 	else
 		printf("Unable to find NDI Webcam Playback Communication Device. Did not set Default Playback Communication Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, NDIWebcam))
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, &NDIWebcam))
 		printf("Set NDI Webcam as Default Recording Device\n");
 	else
 		printf("Unable to find NDI Webcam Recording Device. Did not set Default Recording Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, NDIWebcam))
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, &NDIWebcam))
 		printf("Set NDI Webcam as Default Recording Communication Device\n");
 	else
 		printf("Unable to find NDI Webcam Recording Communication Device. Did not set Default Recording Communication Device.\n");
@@ -377,34 +576,31 @@ static void SetNDIDevices()
 
 static void SetRealtekDevices()
 {
-	wchar_t* RealtekSpeakers = L"*Speakers*Realtek*";
-	wchar_t* RealtekDigital = L"*Digital*Realtek*";
-	wchar_t* RealtekMicrophone = L"*Microphone*Realtek*";
-	wchar_t* RealtekLineIn = L"*Line*In*Realtek*";
-	wchar_t* RealtekStereoMix = L"*Stereo*Mix*Realtek*";
+	PRESET_PATTERN(RealtekSpeakers, L"*Speakers*Realtek*");
+	PRESET_PATTERN(RealtekDigital, L"*Digital*Realtek*");
+	PRESET_PATTERN(RealtekMicrophone, L"*Microphone*Realtek*");
+	PRESET_PATTERN(RealtekLineIn, L"*Line*In*Realtek*");
+	PRESET_PATTERN(RealtekStereoMix, L"*Stereo*Mix*Realtek*");
 
-	SetDevicesWhere(1.0, FALSE, RealtekSpeakers, false);
-	SetDevicesWhere(1.0, FALSE, RealtekDigital, false);
-	SetDevicesWhere(1.0, FALSE, RealtekMicrophone, false);
-	SetDevicesWhere(1.0, FALSE, RealtekLineIn, false);
-	SetDevicesWhere(1.0, FALSE, RealtekStereoMix, false);
+	const CompiledPattern* patterns[] = { &RealtekSpeakers, &RealtekDigital, &RealtekMicrophone, &RealtekLineIn, &RealtekStereoMix };
+	SetDevicesWhereAny(1.0, FALSE, patterns, 5);
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, RealtekSpeakers))
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eRender, &RealtekSpeakers))
 		printf("Set RealtekSpeakers as Default Playback Device\n");
 	else
 		printf("Unable to find RealtekSpeakers Playback Device. Did not set Default Playback Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, RealtekSpeakers))
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eRender, &RealtekSpeakers))
 		printf("Set RealtekSpeakers as Default Playback Communication Device\n");
 	else
 		printf("Unable to find RealtekSpeakers Playback Communication Device. Did not set Default Playback Communication Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, RealtekMicrophone))
+	if (SetDefaultDevicesWhere(ERole::eMultimedia, EDataFlow::eCapture, &RealtekMicrophone))
 		printf("Set RealtekMicrophone as Default Recording Device\n");
 	else
 		printf("Unable to find RealtekMicrophone Recording Device. Did not set Default Recording Device.\n");
 
-	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, RealtekMicrophone))
+	if (SetDefaultDevicesWhere(ERole::eCommunications, EDataFlow::eCapture, &RealtekMicrophone))
 		printf("Set RealtekMicrophone as Default Recording Communication Device\n");
 	else
 		printf("Unable to find RealtekMicrophone Recording Communication Device. Did not set Default Recording Communication Device.\n");
@@ -432,7 +628,7 @@ static char* DwordToString(DWORD _dword)
 		return "Unknown";
 }
 
-static void PrintInfo(DeviceInfo* info)
+static void PrintInfo(DeviceInfo* info, FILE* output)
 {
 	char* flowString;
 	if (info->DataFlow == EDataFlow::eCapture)
@@ -446,78 +642,67 @@ static void PrintInfo(DeviceInfo* info)
 	int precisionInt = 0;
 	int precisionFloat = 2;
 
-	printf("Name: %*ls", widthLong, info->Name);
-	printf("%-*s", widthVeryShort, "");
+	fprintf(output, "Name: %*ls", widthLong, StringText(info->Name));
+	fprintf(output, "%-*s", widthVeryShort, "");
 
-	printf("Scalar: %*.*f ", widthVeryShort, precisionInt, info->VolumeScalar * 100);
-	printf("%-*s", widthVeryShort, "");
+	fprintf(output, "Scalar: %*.*f ", widthVeryShort, precisionInt, info->VolumeScalar * 100);
+	fprintf(output, "%-*s", widthVeryShort, "");
 
-	printf("Level: %*.*f ", widthShort - 1, precisionFloat, info->VolumeLevel);
-	printf("%-*s", widthVeryShort, "");
+	fprintf(output, "Level: %*.*f ", widthShort - 1, precisionFloat, info->VolumeLevel);
+	fprintf(output, "%-*s", widthVeryShort, "");
 
-	printf("%*s ", widthShort, BoolToString(info->IsMute));
+	fprintf(output, "%*s ", widthShort, BoolToString(info->IsMute));
 	//printf("%-*s", widthVeryShort, "");
 
-	printf("%*s ", widthShort + 4, DwordToString(info->State));
-	printf("%-*s", widthVeryShort, "");
+	fprintf(output, "%*s ", widthShort + 4, DwordToString(info->State));
+	fprintf(output, "%-*s", widthVeryShort, "");
 
-	if (info->DataFlow == EDataFlow::eRender)
-	{
-		if (info->IsDefaultPlayback)
-			printf("*");
-		if (info->IsDefaultCommunicationPlayback)
-			printf("**");
-	}
-
-	if (info->DataFlow == EDataFlow::eCapture)
-	{
-		if (info->IsDefaultRecording)
-			printf("*");
-		if (info->IsDefaultCommunicationRecording)
-			printf("**");
-	}
+	if (IsDefaultDevice(info->Id, eMultimedia, info->DataFlow))
+		fprintf(output, "*");
+	if (IsDefaultDevice(info->Id, eCommunications, info->DataFlow))
+		fprintf(output, "**");
 
-	printf("\n");
+	fprintf(output, "\n");
 }
 
-static void PrintAllDevices()
+static void PrintAllDevices(FILE* output)
 {
-	printf("------------ Playback Devices ------------\n");
+	fprintf(output, "------------ Playback Devices ------------\n");
 	for (int i = 0; i < NumDevices; i++) {
 		if (AllDevices[i].Info.DataFlow != EDataFlow::eRender)
 			continue;
 
-		PrintInfo(&AllDevices[i].Info);
+		PrintInfo(&AllDevices[i].Info, output);
 	}
 
-	printf("\n------------ Recording Devices ------------\n");
+	fprintf(output, "\n------------ Recording Devices ------------\n");
 	for (int i = 0; i < NumDevices; i++) {
 		if (AllDevices[i].Info.DataFlow != EDataFlow::eCapture)
 			continue;
 
-		PrintInfo(&AllDevices[i].Info);
+		PrintInfo(&AllDevices[i].Info, output);
 	}
 }
 
 static void SaveInfo(DeviceInfo* info, FILE* config)
 {
-	fprintf(config, "Name: %ls\n", info->Name);
+	fprintf(config, "Name: %ls\n", StringText(info->Name));
 	fprintf(config, "VolumeScalar: %f\n", info->VolumeScalar);
 	fprintf(config, "VolumeLevel: %f\n", info->VolumeLevel);
 	fprintf(config, "Mute: %i\n", info->IsMute);
-	fprintf(config, "DefaultPlayback: %i\n", info->IsDefaultPlayback);
-	fprintf(config, "DefaultPlaybackCommunication: %i\n", info->IsDefaultCommunicationPlayback);
-	fprintf(config, "DefaultRecording: %i\n", info->IsDefaultRecording);
-	fprintf(config, "DefaultRecordingCommunication: %i\n", info->IsDefaultCommunicationRecording);
+	fprintf(config, "DefaultPlayback: %i\n", IsDefaultDevice(info->Id, eMultimedia, eRender));
+	fprintf(config, "DefaultPlaybackCommunication: %i\n", IsDefaultDevice(info->Id, eCommunications, eRender));
+	fprintf(config, "DefaultRecording: %i\n", IsDefaultDevice(info->Id, eMultimedia, eCapture));
+	fprintf(config, "DefaultRecordingCommunication: %i\n", IsDefaultDevice(info->Id, eCommunications, eCapture));
 	fprintf(config, "State: %i\n", info->State);
 	//fprintf(config, "\n");
 }
 
-static void SaveAllInfo() {
-	printf("Saving all audio device information... \n");
+static void SaveAllInfo(const char* path, FILE* output) {
+	fprintf(output, "Saving all audio device information... \n");
 
 	FILE* config;
-	config = (fopen("D:\\CAudioDevices\\config.txt", "w"));
+	config = (fopen(path, "w"));
 	if (config == NULL)
 	{
 		printf("Error!");
@@ -567,12 +752,13 @@ static void LoadInfo2(FILE* config)
 		// Change the working device
 		if (strcmp("Name:", header) == 0)
 		{
+			StringId name = FindString(wline + 6);
 			for (int i = 0; i < NumDevices; i++)
 			{
-				if (lstrcmpW(AllDevices[i].Info.Name, wline + 6) == 0)
+				if (name != STRING_ID_NONE && AllDevices[i].Info.Name == name)
 				{
 					workingDevice = &AllDevices[i];
-					workingDevice->Device->GetState(&workingDevice->Info.State);
+					EndpointUpdateState(workingDevice);
 					break;
 				}
 				else
@@ -587,7 +773,7 @@ static void LoadInfo2(FILE* config)
 			lineFloat = atof(line + 14);
 			if (workingDevice->Info.State == DEVICE_STATE_ACTIVE)
 			{
-				HRESULT test = workingDevice->AudioEndpointVolume->SetMasterVolumeLevelScalar(lineFloat, &GUID_NULL);
+				HRESULT test = EndpointSetVolumeScalar(workingDevice, lineFloat);
 				if (SUCCEEDED(test))
 				{
 					printf("Set volume\n");
@@ -605,129 +791,173 @@ static void LoadInfo2(FILE* config)
 	}
 }
 
-static void LoadInfo(Device* device, FILE* config)
+struct SavedInfo {
+	float VolumeScalar;
+	float VolumeLevel;
+	BOOL IsMute;
+	BOOL DefaultPlayback;
+	BOOL DefaultPlaybackCommunication;
+	BOOL DefaultRecording;
+	BOOL DefaultRecordingCommunication;
+	int State;
+};
+
+// Reads the lines that follow a "Name:" line, as written by SaveInfo
+static void ReadSavedInfo(SavedInfo* saved, FILE* config)
 {
+	char line[100] = {};
+
+	fgets(line, 100, config);
+	saved->VolumeScalar = atof(line + 14);
+	fgets(line, 100, config);
+	saved->VolumeLevel = atof(line + 13);
+	fgets(line, 100, config);
+	saved->IsMute = atoi(line + 6);
+	fgets(line, 100, config);
+	saved->DefaultPlayback = atoi(line + 17);
+	fgets(line, 100, config);
+	saved->DefaultPlaybackCommunication = atoi(line + 30);
+	fgets(line, 100, config);
+	saved->DefaultRecording = atoi(line + 18);
+	fgets(line, 100, config);
+	saved->DefaultRecordingCommunication = atoi(line + 31);
+	fgets(line, 100, config);
+	saved->State = atoi(line + 7);
+}
+
+static void LoadInfo(Device* device, SavedInfo* saved)
+{
+	QueueVisibility(device, true);
+	QueueVolumeScalar(device, saved->VolumeScalar);
+	QueueVolumeLevel(device, saved->VolumeLevel);
+	QueueMute(device, saved->IsMute);
+
+	if (saved->DefaultPlayback == 1)
+		QueueDefault(device, eConsole);
+	if (saved->DefaultPlaybackCommunication == 1)
+		QueueDefault(device, eCommunications);
+	if (saved->DefaultRecording == 1)
+		QueueDefault(device, eConsole);
+	if (saved->DefaultRecordingCommunication == 1)
+		QueueDefault(device, eCommunications);
+
+	if (saved->State == 1)
+		QueueVisibility(device, true);
+	if (saved->State == 2)
+		QueueVisibility(device, false);
+}
+
+// One pass over the file, each record is applied to every device with its
+// name through the name index
+static void LoadAllInfo(const char* path, FILE* output) {
+	fprintf(output, "Loading all audio device information... \n");
+
+	FILE* config;
+	config = (fopen(path, "r"));
+	if (config == NULL)
+	{
+		printf("Error!");
+		exit(1);
+	}
+
 	char line[100];
 	wchar_t wline[100];
-	float lineFloat;
-	bool lineBool;
-	int lineInt;
-
-	while(!feof(config)){
 
-		fgets(line, 100, config);
-		//printf(line);
+	while (fgets(line, 100, config))
+	{
+		if (strncmp(line, "Name: ", 6) != 0)
+			continue;
 
 		// convert char to wide char and remove \n
 		int length = mbstowcs(wline, line, 100);
-		wline[length - 1] = NULL;
+		if (length <= 0 || length >= 100)
+			continue;
+		if (wline[length - 1] == L'\n')
+			wline[length - 1] = L'\0';
 
-		// check name from file to names of audio device
-		if (lstrcmpW(device->Info.Name, wline + 6) == 0)
-		{
-			PolicyConfig->SetEndpointVisibility(device->Info.Id, true);
-			device->Device->GetState(&device->Info.State);
+		SavedInfo saved;
+		ReadSavedInfo(&saved, config);
 
-			// volumeScalar
-			fgets(line, 100, config);
-			lineFloat = atof(line + 14);
-
-			if (device->Info.State == DEVICE_STATE_ACTIVE)
-				device->AudioEndpointVolume->SetMasterVolumeLevelScalar(lineFloat, &GUID_NULL);
-			
-			// VolumeLevel
-			fgets(line, 100, config);
-			lineFloat = atof(line + 13);
-
-			if (device->Info.State == DEVICE_STATE_ACTIVE) 
-				device->AudioEndpointVolume->SetMasterVolumeLevel(lineFloat, &GUID_NULL);
-			
-			// mute
-			fgets(line, 100, config);
-			lineBool = atoi(line + 6);
-
-			if (device->Info.State == DEVICE_STATE_ACTIVE) 
-				device->AudioEndpointVolume->SetMute(lineBool, &GUID_NULL);
-
-			// default playback
-			fgets(line, 100, config);
-			lineBool = atoi(line + 17);
-
-			if (device->Info.State == DEVICE_STATE_ACTIVE && lineBool == 1)
-				PolicyConfig->SetDefaultEndpoint(device->Info.Id, eConsole);
-
-			// default playbackcomm
-			fgets(line, 100, config);
-			lineBool = atoi(line + 30);
-
-			if (device->Info.State == DEVICE_STATE_ACTIVE && lineBool == 1)
-				PolicyConfig->SetDefaultEndpoint(device->Info.Id, eCommunications);
-			
-			// default recording
-			fgets(line, 100, config);
-			lineBool = atoi(line + 18);
-
-			if (device->Info.State == DEVICE_STATE_ACTIVE && lineBool == 1)
-				PolicyConfig->SetDefaultEndpoint(device->Info.Id, eConsole);
-
-			// default recordingcomm
-			fgets(line, 100, config);
-			lineBool = atoi(line + 31);
-
-			if (device->Info.State == DEVICE_STATE_ACTIVE && lineBool == 1)
-				PolicyConfig->SetDefaultEndpoint(device->Info.Id, eCommunications);
-
-			// state
-			fgets(line, 100, config);
-			lineInt = atoi(line + 7);
-			if (lineInt == 1)
-				PolicyConfig->SetEndpointVisibility(device->Info.Id, true);
-			if (lineInt == 2)
-				PolicyConfig->SetEndpointVisibility(device->Info.Id, false);
-			//if (lineInt == 8)
-			//	PolicyConfig->SetEndpointVisibility(device->Info.Id, true);
-
-
-			fgets(line, 100, config);
-			//fgets(line, 100, config);
-			//printf("\n");
-		}
-		else
+		for (int i = FindDeviceIndexByName(FindString(wline + 6)); i >= 0; i = NextDeviceWithName[i])
 		{
-			// do nothing
-			//printf("No match.\n\n");
+			LoadInfo(&AllDevices[i], &saved);
 		}
 	}
 
-	
+	fclose(config);
 }
 
-static void LoadAllInfo() {
-	printf("Loading all audio device information... \n");
+#include "audio_stress.cpp"
+#include "audio_idle.cpp"
+#include "audio_history.cpp"
 
-	FILE* config;
-	config = (fopen("D:\\CAudioDevices\\config.txt", "r"));
-	if (config == NULL)
+#ifdef _WIN32
+#include "audio_sessions.cpp"
+#include "audio_rules.cpp"
+#endif
+
+int main(int numArguments, char* arguments[])
+{
+	// Runs on synthetic devices, no audio system needed
+	if (numArguments >= 2 && strcmp(arguments[1], "-stress") == 0)
+		return RunStressTest(numArguments > 2 ? atoi(arguments[2]) : 100000) ? 0 : 1;
+
+	// Synthetic devices and PCM, no audio system needed
+	if (numArguments == 2 && strcmp(arguments[1], "-idle-test") == 0)
+		return RunIdleTest() ? 0 : 1;
+
+	// Reads a history file, no audio system needed
+	if ((numArguments == 4 || numArguments == 5) && strcmp(arguments[1], "-timeline") == 0)
 	{
-		printf("Error!");
-		exit(1);
+		wchar_t pattern[100];
+		swprintf(pattern, 100, L"%hs", arguments[3]);
+		PrintTimeline(arguments[2], pattern, numArguments == 5 ? atoi(arguments[4]) : 0);
+		return 0;
+	}
+
+	// -switch, -metrics, -record and -replay wrap any other command
+	while (numArguments >= 3)
+	{
+		if (strcmp(arguments[1], "-switch") == 0)
+		{
+			SwitchMode = true;
+			arguments += 1;
+			numArguments -= 1;
+			continue;
+		}
+
+		if (numArguments < 4)
+			break;
+
+		if (strcmp(arguments[1], "-metrics") == 0)
+		{
+			Metrics.Path = arguments[2];
+		}
+		else if (strcmp(arguments[1], "-record") == 0 || strcmp(arguments[1], "-replay") == 0)
+		{
+			TraceMode mode = strcmp(arguments[1], "-record") == 0 ? TraceMode_Record : TraceMode_Replay;
+			if (!StartTrace(mode, arguments[2]))
+				return 1;
+		}
+		else
+		{
+			break;
+		}
+
+		arguments += 2;
+		numArguments -= 2;
 	}
 
-	for (size_t i = 0; i < NumDevices; i++) {
-		rewind(config);
-		LoadInfo(&AllDevices[i], config);
+	if (Trace.Mode != TraceMode_Replay && !PlatformInitialize())
+	{
+		printf("Unable to connect to the audio system.\n");
+		return 1;
 	}
-		
-	
-	fclose(config);
-}
 
-int main(int numArguments, char* arguments[])
-{
-	CoInitialize(NULL);
 	InitializeAndPopulateAllDevices();
 
 	wchar_t clause[100];
+	wchar_t deviceClause[100];
 	bool invalid = false;
 
 	if (numArguments == 2)
@@ -742,15 +972,19 @@ int main(int numArguments, char* arguments[])
 		}
 		else if (strcmp(arguments[1], "-l") == 0)
 		{
-			PrintAllDevices();
+			PrintAllDevices(stdout);
+		}
+		else if (strcmp(arguments[1], "-details") == 0)
+		{
+			PrintDetailsWhere(NULL, stdout);
 		}
 		else if (strcmp(arguments[1], "-save") == 0)
 		{
-			SaveAllInfo();
+			SaveAllInfo(CONFIG_PATH, stdout);
 		}
 		else if (strcmp(arguments[1], "-load") == 0)
 		{
-			LoadAllInfo();
+			LoadAllInfo(CONFIG_PATH, stdout);
 		}
 		else if (strcmp(arguments[1], "-r") == 0)
 		{
@@ -758,7 +992,7 @@ int main(int numArguments, char* arguments[])
 		}
 		else if (strcmp(arguments[1], "-Astro") == 0)
 		{
-			SetAstroDevices();
+			SetAstroDevices(stdout);
 		}
 		else if (strcmp(arguments[1], "-TC") == 0)
 		{
@@ -772,6 +1006,12 @@ int main(int numArguments, char* arguments[])
 		{
 			SetRealtekDevices();
 		}
+#ifdef _WIN32
+		else if (strcmp(arguments[1], "-sessions") == 0)
+		{
+			PrintAllSessions();
+		}
+#endif
 		else
 		{
 			invalid = true;
@@ -779,7 +1019,12 @@ int main(int numArguments, char* arguments[])
 	}
 	else if (numArguments == 3)
 	{
-		if (strcmp(arguments[1], "-u") == 0)
+		if (strcmp(arguments[1], "-details") == 0)
+		{
+			swprintf(clause, 100, L"%hs", arguments[2]);
+			PrintDetailsWhere(clause, stdout);
+		}
+		else if (strcmp(arguments[1], "-u") == 0)
 		{
 			// Unmute all matching devices
 			swprintf(clause, 100, L"%hs", arguments[2]);
@@ -803,9 +1048,79 @@ int main(int numArguments, char* arguments[])
 			swprintf(clause, 100, L"%hs", arguments[2]);
 			SetDevicesWhere(0.0, TRUE, clause, true);
 		}
+#ifdef _WIN32
+		else if (strcmp(arguments[1], "-sm") == 0)
+		{
+			// Mute all sessions of matching processes
+			swprintf(clause, 100, L"%hs", arguments[2]);
+			SetSessionsWhere(clause, NULL, 0.0, TRUE, false, true);
+		}
+		else if (strcmp(arguments[1], "-su") == 0)
+		{
+			// Unmute all sessions of matching processes
+			swprintf(clause, 100, L"%hs", arguments[2]);
+			SetSessionsWhere(clause, NULL, 0.0, FALSE, false, true);
+		}
+		else if (strcmp(arguments[1], "-watch") == 0)
+		{
+			// Apply rules from a file as devices change
+			WatchDevices(arguments[2]);
+		}
+#endif
+		else if (strcmp(arguments[1], "-refresh") == 0)
+		{
+			// Re-enumerate repeatedly and report live resources
+			RefreshAllDevices(atoi(arguments[2]));
+		}
+		else if (strcmp(arguments[1], "-history") == 0)
+		{
+			// Record state changes once a second until stopped
+			RecordHistory(arguments[2], 1);
+		}
 		else
 			invalid = true;
 	}
+	else if (numArguments == 4)
+	{
+		swprintf(clause, 100, L"%hs", arguments[2]);
+		swprintf(deviceClause, 100, L"%hs", arguments[3]);
+
+		if (strcmp(arguments[1], "-history") == 0)
+		{
+			// Record state changes at a given interval until stopped
+			RecordHistory(arguments[2], atoi(arguments[3]) > 0 ? atoi(arguments[3]) : 1);
+		}
+		else if (strcmp(arguments[1], "-idle") == 0)
+		{
+			// Mute matching devices that stay silent, until stopped
+			RunIdleMonitor(clause, atoi(arguments[3]) > 0 ? atoi(arguments[3]) : 1, 0.0f);
+		}
+#ifdef _WIN32
+		else if (strcmp(arguments[1], "-sm") == 0)
+		{
+			// Mute sessions of matching processes on matching devices
+			SetSessionsWhere(clause, deviceClause, 0.0, TRUE, false, true);
+		}
+		else if (strcmp(arguments[1], "-su") == 0)
+		{
+			// Unmute sessions of matching processes on matching devices
+			SetSessionsWhere(clause, deviceClause, 0.0, FALSE, false, true);
+		}
+		else if (strcmp(arguments[1], "-sv") == 0)
+		{
+			// Set the volume of all sessions of matching processes
+			SetSessionsWhere(clause, NULL, atof(arguments[3]) / 100.0f, FALSE, true, false);
+		}
+#endif
+		else
+			invalid = true;
+	}
+	else if (numArguments == 5 && strcmp(arguments[1], "-idle") == 0)
+	{
+		// Duck instead of mute
+		swprintf(clause, 100, L"%hs", arguments[2]);
+		RunIdleMonitor(clause, atoi(arguments[3]) > 0 ? atoi(arguments[3]) : 1, (float)fabs(atof(arguments[4])));
+	}
 	else
 	{
 		invalid = true;
@@ -815,6 +1130,7 @@ int main(int numArguments, char* arguments[])
 	{
 		printf("\nUnknown or missing arguments.\n\n");
 		printf(" -l\t\tList all playback and recording devices.\n");
+		printf(" -details [clause]\tList form factor, bus, mix format and period, optionally of devices matching a name, form factor or bus.\n");
 		printf(" -e\t\tEnable all playback and recording devices.\n");
 		printf(" -d\t\tDisable all playback and recording devices.\n");
 		printf(" -save\t\tSave all audio device info to a file.\n");
@@ -822,13 +1138,33 @@ int main(int numArguments, char* arguments[])
 
 		printf("\n");
 		printf(" -r\t\tRandomize mute, volume, default, and default communication devices.\n");
+#ifdef _WIN32
+		printf(" -watch <file>\tApply the rules in a file whenever a device changes state.\n");
+#endif
+		printf(" -refresh <n>\tRe-enumerate all devices n times and print live resource counts.\n");
+		printf(" -history <file> [s]\tRecord every device's volume, mute, state and defaults every s seconds.\n");
+		printf(" -timeline <file> <clause> [min]\tPrint the recorded history of matching devices, optionally only the last min minutes.\n");
+		printf(" -idle <clause> <s> [dB]\tMute, or duck by dB, matching devices silent for s seconds and restore them when signal returns.\n");
+		printf(" -idle-test\tCheck idle detection on synthetic devices and PCM.\n");
+		printf(" -stress [n]\tCheck the search kernels, then time every operation on synthetic devices, up to n, and fail on super-linear growth.\n");
+		printf(" -switch <command>\tMute targets, flip defaults, then unmute, and report how long the switch took.\n");
+		printf(" -metrics <file> <command>\tRun a command and write endpoint call counts and latencies in Prometheus format.\n");
+		printf(" -record <file> <command>\tRun a command and record every endpoint call to a trace.\n");
+		printf(" -replay <file> <command>\tRun a command against a recorded trace instead of the audio system.\n");
+		printf("\n");
+		printf(" -u <clause>\tUnmute and max volume all devices whose name, form factor or bus matches given clause.\n");
+		printf(" -un <clause>\tUnmute and max volume all devices whose name, form factor or bus does NOT match given clause.\n");
 		printf("\n");
-		printf(" -u <clause>\tUnmute and max volume all devices matching given clause.\n");
-		printf(" -un <clause>\tUnmute and max volume all devices NOT matching given clause.\n");
+		printf(" -m <clause>\tMute and 0 volume all devices whose name, form factor or bus matches given clause.\n");
+		printf(" -mn <clause>\tMute and 0 volume all devices whose name, form factor or bus does NOT match given clause.\n");
 		printf("\n");
-		printf(" -m <clause>\tMute and 0 volume all devices matching given clause.\n");
-		printf(" -mn <clause>\tMute and 0 volume all devices NOT matching given clause.\n");
+#ifdef _WIN32
+		printf(" -sessions\tList the audio sessions of every active device.\n");
+		printf(" -sm <process> [device]\tMute sessions of matching processes, optionally only on matching devices.\n");
+		printf(" -su <process> [device]\tUnmute sessions of matching processes, optionally only on matching devices.\n");
+		printf(" -sv <process> <percent>\tSet the volume of all sessions of matching processes.\n");
 		printf("\n");
+#endif
 		printf(" -Astro\t\tSet Default devices to expected Astro devices.\n");
 		printf(" -Realtek\tSet Default devices to expected Realtek devices.\n");
 		printf(" -NDI\t\tSet Default devices to expected NDI devices.\n");
@@ -838,7 +1174,18 @@ int main(int numArguments, char* arguments[])
 		printf("\n");
 	}
 
-
+	if (SwitchMode)
+		SwitchCommands();
+	FlushCommands();
+
+#ifdef _WIN32
+	ReleaseSessions();
+#endif
+	ReleaseAllDevices();
+	FinishTrace();
+	WriteMetrics();
+	if (Trace.Mode != TraceMode_Replay)
+		PlatformShutdown();
 
 	return 0;
 }
\ No newline at end of file
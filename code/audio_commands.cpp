@@ -0,0 +1,188 @@
+// Write-combining buffer for endpoint writes.
+//
+// Commands queue their writes here instead of calling the endpoint
+// directly. Each device keeps only the last write to each field, and
+// volume is one field whether it was written as a level or a scalar, so a
+// command costs at most one call per device and field. FlushCommands then
+// issues them in an order that works:
+//
+//     1. show hidden devices that were shown, or that have volume or mute
+//        writes, and re-read their state
+//     2. volume and mute on active devices, skipping values they already have
+//        when those were read from the endpoint
+//     3. defaults, last device per role and flow, skipping inactive devices
+//        and current defaults
+//     4. hide devices whose last visibility write was hidden
+
+#define COMMAND_SHOW 0x1
+#define COMMAND_VISIBILITY 0x2
+#define COMMAND_VOLUME 0x4
+#define COMMAND_MUTE 0x8
+
+struct DeviceCommands {
+	BYTE Fields;
+	bool Visible;
+	bool VolumeIsLevel;
+	float Volume;
+	BOOL Mute;
+};
+
+struct CommandBuffer {
+	DeviceCommands* Devices;
+	UINT Capacity;
+
+	// Devices with pending writes, in the order they were first written
+	int* Dirty;
+	UINT NumDirty;
+
+	// AllDevices index + 1 of the last default write, 0 for none
+	int Defaults[ERole_enum_count][2];
+};
+
+static CommandBuffer Commands;
+
+static DeviceCommands* GetDeviceCommands(Device* device)
+{
+	if (Commands.Capacity < DeviceCapacity)
+	{
+		// Only grows between commands, when nothing is pending
+		ArenaFree(Commands.Devices);
+		ArenaFree(Commands.Dirty);
+		Commands.Capacity = DeviceCapacity;
+		Commands.Devices = (DeviceCommands*)ArenaAlloc(Commands.Capacity * sizeof(DeviceCommands));
+		Commands.Dirty = (int*)ArenaAlloc(Commands.Capacity * sizeof(int));
+		Commands.NumDirty = 0;
+	}
+
+	int index = (int)(device - AllDevices);
+	DeviceCommands* commands = &Commands.Devices[index];
+
+	if (commands->Fields == 0)
+		Commands.Dirty[Commands.NumDirty++] = index;
+
+	return commands;
+}
+
+static void QueueVisibility(Device* device, bool visible)
+{
+	DeviceCommands* commands = GetDeviceCommands(device);
+	commands->Fields |= COMMAND_VISIBILITY;
+	commands->Visible = visible;
+
+	if (visible)
+		commands->Fields |= COMMAND_SHOW;
+}
+
+static void QueueVolumeScalar(Device* device, float volumeScalar)
+{
+	DeviceCommands* commands = GetDeviceCommands(device);
+	commands->Fields |= COMMAND_VOLUME;
+	commands->VolumeIsLevel = false;
+	commands->Volume = volumeScalar;
+}
+
+static void QueueVolumeLevel(Device* device, float volumeLevel)
+{
+	DeviceCommands* commands = GetDeviceCommands(device);
+	commands->Fields |= COMMAND_VOLUME;
+	commands->VolumeIsLevel = true;
+	commands->Volume = volumeLevel;
+}
+
+static void QueueMute(Device* device, BOOL mute)
+{
+	DeviceCommands* commands = GetDeviceCommands(device);
+	commands->Fields |= COMMAND_MUTE;
+	commands->Mute = mute;
+}
+
+static void QueueDefault(Device* device, ERole role)
+{
+	Commands.Defaults[role][device->Info.DataFlow] = (int)(device - AllDevices) + 1;
+}
+
+static void FlushVolume(Device* device, DeviceCommands* commands)
+{
+	DeviceInfo* info = &device->Info;
+
+	// Values that were never read cannot be compared, so those writes are
+	// always issued
+	bool elide = info->HasVolume;
+
+	if (commands->Fields & COMMAND_VOLUME)
+	{
+		if (commands->VolumeIsLevel && (!elide || commands->Volume != info->VolumeLevel))
+		{
+			if (SUCCEEDED(EndpointSetVolumeLevel(device, commands->Volume)))
+				info->VolumeLevel = commands->Volume;
+		}
+		else if (!commands->VolumeIsLevel && (!elide || commands->Volume != info->VolumeScalar))
+		{
+			if (SUCCEEDED(EndpointSetVolumeScalar(device, commands->Volume)))
+				info->VolumeScalar = commands->Volume;
+		}
+	}
+
+	if ((commands->Fields & COMMAND_MUTE) && (!elide || (commands->Mute != 0) != (info->IsMute != 0)))
+	{
+		if (SUCCEEDED(EndpointSetMute(device, commands->Mute)))
+			info->IsMute = commands->Mute;
+	}
+}
+
+static void FlushCommands(void)
+{
+	for (UINT d = 0; d < Commands.NumDirty; d++)
+	{
+		Device* device = &AllDevices[Commands.Dirty[d]];
+		DeviceCommands* commands = &Commands.Devices[Commands.Dirty[d]];
+
+		// Hidden devices are shown for their volume writes even when they
+		// end up hidden again
+		bool writesVolume = (commands->Fields & (COMMAND_VOLUME | COMMAND_MUTE)) != 0;
+		bool show = (commands->Fields & COMMAND_SHOW) && (commands->Visible || writesVolume);
+
+		if (show && device->Info.State != DEVICE_STATE_ACTIVE)
+		{
+			EndpointSetVisibility(device, true);
+			EndpointUpdateState(device);
+		}
+	}
+
+	for (UINT d = 0; d < Commands.NumDirty; d++)
+	{
+		Device* device = &AllDevices[Commands.Dirty[d]];
+		if (device->Info.State == DEVICE_STATE_ACTIVE)
+			FlushVolume(device, &Commands.Devices[Commands.Dirty[d]]);
+	}
+
+	for (int role = 0; role < ERole_enum_count; role++)
+	{
+		for (int dataFlow = 0; dataFlow < 2; dataFlow++)
+		{
+			int index = Commands.Defaults[role][dataFlow] - 1;
+			Commands.Defaults[role][dataFlow] = 0;
+
+			if (index < 0 || AllDevices[index].Info.State != DEVICE_STATE_ACTIVE)
+				continue;
+			if (GetDefaultDeviceIndex((ERole)role, (EDataFlow)dataFlow) == index)
+				continue;
+
+			if (SUCCEEDED(EndpointSetDefault(&AllDevices[index], (ERole)role)))
+				SetDefaultDeviceIndex((ERole)role, (EDataFlow)dataFlow, index);
+		}
+	}
+
+	for (UINT d = 0; d < Commands.NumDirty; d++)
+	{
+		Device* device = &AllDevices[Commands.Dirty[d]];
+		DeviceCommands* commands = &Commands.Devices[Commands.Dirty[d]];
+
+		if ((commands->Fields & COMMAND_VISIBILITY) && !commands->Visible)
+			EndpointSetVisibility(device, false);
+
+		*commands = {};
+	}
+
+	Commands.NumDirty = 0;
+}
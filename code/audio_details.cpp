@@ -0,0 +1,238 @@
+// Extended endpoint details, listed with -details [clause].
+//
+// Each device costs one pass over its property store for the form factor,
+// the bus and a change stamp. The mix format and processing periods each
+// cost a call to the audio service, so they are cached in DETAILS_PATH by
+// endpoint Id and asked for again only when the stamp has changed. One line
+// per device:
+//
+//     stamp flags rate channels bits defaultPeriod minimumPeriod id
+//
+// A clause selects devices by name, form factor or bus, so "-details Headset"
+// and "-details USB" work as well as name patterns. The -m, -u, -mn and -un
+// clauses select the same way, but read the property stores only when the
+// clause matches a form factor or bus name at all.
+
+static const wchar_t* FormFactorNames[EndpointFormFactor_enum_count] = {
+	L"Network",
+	L"Speakers",
+	L"Line level",
+	L"Headphones",
+	L"Microphone",
+	L"Headset",
+	L"Handset",
+	L"Digital",
+	L"S/PDIF",
+	L"Display",
+	L"Unknown",
+};
+
+static const wchar_t* BusNames[Bus_Count] = {
+	L"Unknown",
+	L"Internal",
+	L"USB",
+	L"Bluetooth",
+	L"Virtual",
+};
+
+static void ReadDetailsCache(const char* path)
+{
+	FILE* cache = fopen(path, "r");
+	if (cache == NULL)
+		return;
+
+	char line[512];
+	while (fgets(line, sizeof(line), cache))
+	{
+		UINT stamp, flags, sampleRate, channels, bits;
+		long long defaultPeriod, minimumPeriod;
+		int consumed = 0;
+
+		if (sscanf(line, "%u %u %u %u %u %lld %lld %n", &stamp, &flags, &sampleRate, &channels, &bits,
+			&defaultPeriod, &minimumPeriod, &consumed) != 7)
+			continue;
+
+		char* id = line + consumed;
+		id[strcspn(id, "\r\n")] = '\0';
+
+		wchar_t wideId[256];
+		if (mbstowcs(wideId, id, 256) == (size_t)-1)
+			continue;
+		wideId[255] = L'\0';
+
+		// Entries for devices that are gone or have changed are dropped
+		int index = FindDeviceIndex(FindString(wideId));
+		if (index < 0)
+			continue;
+
+		DeviceDetails* details = &AllDevices[index].Details;
+		if (!(details->Flags & DETAILS_PROPERTIES) || details->Stamp != stamp)
+			continue;
+
+		details->SampleRate = sampleRate;
+		details->Channels = (WORD)channels;
+		details->BitsPerSample = (WORD)bits;
+		details->DefaultPeriod = defaultPeriod;
+		details->MinimumPeriod = minimumPeriod;
+		details->Flags |= DETAILS_FORMAT | (flags & DETAILS_FLOAT);
+	}
+
+	fclose(cache);
+}
+
+static void WriteDetailsCache(const char* path)
+{
+	FILE* cache = fopen(path, "w");
+	if (cache == NULL)
+	{
+		printf("Unable to write %s\n", path);
+		return;
+	}
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		DeviceDetails* details = &AllDevices[i].Details;
+		if (!(details->Flags & DETAILS_FORMAT))
+			continue;
+
+		fprintf(cache, "%u %u %u %u %u %lld %lld %ls\n",
+			(UINT)details->Stamp, (UINT)details->Flags, (UINT)details->SampleRate,
+			(UINT)details->Channels, (UINT)details->BitsPerSample,
+			(long long)details->DefaultPeriod, (long long)details->MinimumPeriod, StringText(AllDevices[i].Info.Id));
+	}
+
+	fclose(cache);
+}
+
+static void ReadAllDetailsProperties(void)
+{
+	for (int i = 0; i < NumDevices; i++)
+	{
+		DeviceDetails* details = &AllDevices[i].Details;
+		*details = {};
+
+		if (SUCCEEDED(EndpointReadDetails(&AllDevices[i], details)))
+			details->Flags |= DETAILS_PROPERTIES;
+	}
+}
+
+// Fills Details for every device and returns how many formats were queried
+// instead of taken from the cache
+static int LoadAllDetails(const char* path)
+{
+	ReadAllDetailsProperties();
+	ReadDetailsCache(path);
+
+	// Only active endpoints have a mix format
+	int queried = 0;
+	for (int i = 0; i < NumDevices; i++)
+	{
+		Device* device = &AllDevices[i];
+		DeviceDetails* details = &device->Details;
+
+		if (!(details->Flags & DETAILS_PROPERTIES) || (details->Flags & DETAILS_FORMAT))
+			continue;
+		if (device->Info.State != DEVICE_STATE_ACTIVE)
+			continue;
+
+		if (SUCCEEDED(EndpointQueryFormat(device, details)))
+			details->Flags |= DETAILS_FORMAT;
+		queried++;
+	}
+
+	if (queried > 0)
+		WriteDetailsCache(path);
+
+	return queried;
+}
+
+static bool MatchText(const NamePattern* pattern, const wchar_t* text)
+{
+	if (pattern->IsCompiled)
+		return MatchPattern(&pattern->Compiled, text, (int)wcslen(text));
+	return match(pattern->Text, text, 0, 0);
+}
+
+static bool MatchDetails(const NamePattern* pattern, Device* device)
+{
+	DeviceDetails* details = &device->Details;
+
+	if (MatchName(pattern, device->Info.Name))
+		return true;
+	if (!(details->Flags & DETAILS_PROPERTIES))
+		return false;
+
+	return MatchText(pattern, FormFactorNames[details->FormFactor]) || MatchText(pattern, BusNames[details->Bus]);
+}
+
+// Whether the pattern can select a device by something other than its name
+static bool MatchesAnyDetails(const NamePattern* pattern)
+{
+	for (int i = 0; i < EndpointFormFactor_enum_count; i++)
+	{
+		if (MatchText(pattern, FormFactorNames[i]))
+			return true;
+	}
+
+	for (int i = 0; i < Bus_Count; i++)
+	{
+		if (MatchText(pattern, BusNames[i]))
+			return true;
+	}
+
+	return false;
+}
+
+static void PrintDetails(Device* device, FILE* output)
+{
+	DeviceDetails* details = &device->Details;
+
+	fprintf(output, "Name: %50ls   ", StringText(device->Info.Name));
+
+	if (!(details->Flags & DETAILS_PROPERTIES))
+	{
+		fprintf(output, "unavailable\n");
+		return;
+	}
+
+	fprintf(output, "%-11ls %-10ls", FormFactorNames[details->FormFactor], BusNames[details->Bus]);
+
+	if (details->Flags & DETAILS_FORMAT)
+	{
+		fprintf(output, "%6u Hz %2u ch %2u-bit %-5s", (UINT)details->SampleRate, (UINT)details->Channels,
+			(UINT)details->BitsPerSample, (details->Flags & DETAILS_FLOAT) ? "float" : "int");
+
+		if (details->DefaultPeriod > 0)
+			fprintf(output, "  period %.2f ms", details->DefaultPeriod / 10000.0);
+		if (details->MinimumPeriod > 0)
+			fprintf(output, " (min %.2f ms)", details->MinimumPeriod / 10000.0);
+	}
+	else
+	{
+		fprintf(output, "no mix format");
+	}
+
+	fprintf(output, "\n");
+}
+
+static void PrintDetailsWhere(const wchar_t* pattern, FILE* output)
+{
+	int queried = LoadAllDetails(DETAILS_PATH);
+	NamePattern namePattern = MakeNamePattern(pattern ? pattern : L"*");
+
+	fprintf(output, "------------ Playback Devices ------------\n");
+	for (int i = 0; i < NumDevices; i++)
+	{
+		if (AllDevices[i].Info.DataFlow == eRender && MatchDetails(&namePattern, &AllDevices[i]))
+			PrintDetails(&AllDevices[i], output);
+	}
+
+	fprintf(output, "\n------------ Recording Devices ------------\n");
+	for (int i = 0; i < NumDevices; i++)
+	{
+		if (AllDevices[i].Info.DataFlow == eCapture && MatchDetails(&namePattern, &AllDevices[i]))
+			PrintDetails(&AllDevices[i], output);
+	}
+
+	fprintf(output, "\nQueried %d mix formats, cached in %s\n", queried, DETAILS_PATH);
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+// Owning handles for the COM objects and CoTaskMem allocations the tool holds.
+// Each handle is the size of what it wraps. They are safe to place in zeroed
+// memory (VirtualAlloc) without running a constructor, and they are released
+// explicitly with Reset() or by going out of scope.
+
+struct ResourceCounters {
+	volatile LONG ComObjects;
+	volatile LONG Strings;
+	volatile LONG PropVariants;
+	volatile LONGLONG Bytes;
+};
+
+static ResourceCounters GlobalResources;
+
+static SIZE_T WideStringBytes(const wchar_t* string)
+{
+	if (string == NULL)
+		return 0;
+	return (lstrlenW(string) + 1) * sizeof(wchar_t);
+}
+
+template <typename T>
+struct ComHandle;
+
+template <typename T>
+struct ComOut {
+	ComHandle<T>* Handle;
+
+	operator T**() { return &Handle->Ptr; }
+	operator void**() { return (void**)&Handle->Ptr; }
+	~ComOut()
+	{
+		if (Handle->Ptr)
+			InterlockedIncrement(&GlobalResources.ComObjects);
+	}
+};
+
+template <typename T>
+struct ComHandle {
+	T* Ptr;
+
+	ComHandle() : Ptr(NULL) {}
+	ComHandle(const ComHandle&) = delete;
+	ComHandle& operator=(const ComHandle&) = delete;
+	~ComHandle() { Reset(); }
+
+	void Reset()
+	{
+		if (Ptr)
+		{
+			Ptr->Release();
+			Ptr = NULL;
+			InterlockedDecrement(&GlobalResources.ComObjects);
+		}
+	}
+
+	// Releases the current object and hands the slot to an out-parameter.
+	ComOut<T> Put()
+	{
+		Reset();
+		return ComOut<T>{ this };
+	}
+
+	T* Get() const { return Ptr; }
+	T* operator->() const { return Ptr; }
+	explicit operator bool() const { return Ptr != NULL; }
+};
+
+struct CoTaskMemString;
+
+struct CoTaskMemStringOut {
+	CoTaskMemString* Handle;
+
+	operator LPWSTR*();
+	~CoTaskMemStringOut();
+};
+
+struct CoTaskMemString {
+	LPWSTR Ptr;
+
+	CoTaskMemString() : Ptr(NULL) {}
+	CoTaskMemString(const CoTaskMemString&) = delete;
+	CoTaskMemString& operator=(const CoTaskMemString&) = delete;
+	~CoTaskMemString() { Reset(); }
+
+	void Reset()
+	{
+		if (Ptr)
+		{
+			InterlockedDecrement(&GlobalResources.Strings);
+			InterlockedExchangeAdd64(&GlobalResources.Bytes, -(LONGLONG)WideStringBytes(Ptr));
+			CoTaskMemFree(Ptr);
+			Ptr = NULL;
+		}
+	}
+
+	CoTaskMemStringOut Put()
+	{
+		Reset();
+		return CoTaskMemStringOut{ this };
+	}
+
+	LPWSTR Get() const { return Ptr; }
+	explicit operator bool() const { return Ptr != NULL; }
+};
+
+inline CoTaskMemStringOut::operator LPWSTR*() { return &Handle->Ptr; }
+
+inline CoTaskMemStringOut::~CoTaskMemStringOut()
+{
+	if (Handle->Ptr)
+	{
+		InterlockedIncrement(&GlobalResources.Strings);
+		InterlockedExchangeAdd64(&GlobalResources.Bytes, (LONGLONG)WideStringBytes(Handle->Ptr));
+	}
+}
+
+struct PropVariant;
+
+struct PropVariantOut {
+	PropVariant* Handle;
+
+	operator PROPVARIANT*();
+	~PropVariantOut();
+};
+
+struct PropVariant {
+	PROPVARIANT Value;
+
+	PropVariant() { PropVariantInit(&Value); }
+	PropVariant(const PropVariant&) = delete;
+	PropVariant& operator=(const PropVariant&) = delete;
+	~PropVariant() { Reset(); }
+
+	SIZE_T Bytes() const
+	{
+		if (Value.vt == VT_LPWSTR)
+			return WideStringBytes(Value.pwszVal);
+		return 0;
+	}
+
+	void Reset()
+	{
+		if (Value.vt != VT_EMPTY)
+		{
+			InterlockedDecrement(&GlobalResources.PropVariants);
+			InterlockedExchangeAdd64(&GlobalResources.Bytes, -(LONGLONG)Bytes());
+			PropVariantClear(&Value);
+		}
+	}
+
+	PropVariantOut Put()
+	{
+		Reset();
+		return PropVariantOut{ this };
+	}
+};
+
+inline PropVariantOut::operator PROPVARIANT*() { return &Handle->Value; }
+
+inline PropVariantOut::~PropVariantOut()
+{
+	if (Handle->Value.vt != VT_EMPTY)
+	{
+		InterlockedIncrement(&GlobalResources.PropVariants);
+		InterlockedExchangeAdd64(&GlobalResources.Bytes, (LONGLONG)Handle->Bytes());
+	}
+}
+
+static void PrintResourceCounters(const char* label)
+{
+	printf("%s: %ld COM objects, %ld strings, %ld propvariants, %lld bytes\n",
+		label,
+		GlobalResources.ComObjects,
+		GlobalResources.Strings,
+		GlobalResources.PropVariants,
+		GlobalResources.Bytes);
+}
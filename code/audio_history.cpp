@@ -0,0 +1,615 @@
+// Endpoint state history.
+//
+// -history <file> [seconds] samples every endpoint's volume, mute, state and
+// default roles, by default once a second, and appends a record whenever
+// something changed. -timeline <file> <pattern> [minutes] prints the changes
+// of the matching devices.
+//
+// Records are grouped in blocks of HISTORY_BLOCK_MS. Each block opens with
+// a keyframe holding the full state of every device, so a reader can start
+// at any block. <file>.idx holds the start time and offset of every block,
+// so a query seeks straight to the block covering its start time. When the
+// file passes HISTORY_MAX_BYTES it is moved to <file>.old, along with its
+// index, and a new one is started.
+//
+// A record is a field mask byte, then, unless it is a block header, a
+// varint of milliseconds since the previous record and a varint device slot,
+// then the fields named by the mask. Volume is per mille, stored as a zigzag
+// delta from the device's previous volume. Slots are assigned the first time
+// a device is seen and are defined again in every keyframe.
+
+#define HISTORY_VOLUME 0x01
+#define HISTORY_MUTE 0x02
+#define HISTORY_MUTED 0x04
+#define HISTORY_STATE 0x08
+#define HISTORY_DEFAULTS 0x10
+#define HISTORY_DEFINE 0x20
+#define HISTORY_REMOVED 0x40
+#define HISTORY_BLOCK 0x80
+
+#define HISTORY_BLOCK_MS 60000
+#define HISTORY_MAX_BYTES (16 * 1024 * 1024)
+#define HISTORY_MAX_SLOTS 4096
+
+struct HistorySlot {
+	wchar_t Id[128];
+	bool Present;
+	int Volume;
+	BOOL IsMute;
+	DWORD State;
+	BYTE Defaults;
+};
+
+struct HistoryRecorder {
+	const char* Path;
+	FILE* Data;
+	FILE* Index;
+	UINT DataSize;
+
+	UINT64 BlockStart;
+	UINT64 LastRecord;
+
+	HistorySlot* Slots;
+	UINT NumSlots;
+
+	// Slot of each device in AllDevices, or -1
+	int* SlotOfDevice;
+	UINT SlotOfDeviceCapacity;
+
+	BYTE Record[1024];
+	UINT RecordSize;
+};
+
+static HistoryRecorder History;
+static volatile LONG StopHistory;
+
+static UINT64 GetWallClockMilliseconds(void)
+{
+#ifdef _WIN32
+	// 100ns intervals since 1601
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	UINT64 intervals = ((UINT64)now.dwHighDateTime << 32) | now.dwLowDateTime;
+	return intervals / 10000 - 11644473600000ULL;
+#else
+	timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (UINT64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+static void PutByte(BYTE value)
+{
+	if (History.RecordSize < sizeof(History.Record))
+		History.Record[History.RecordSize++] = value;
+}
+
+static void PutVarint(UINT64 value)
+{
+	do
+	{
+		BYTE byte = value & 0x7F;
+		value >>= 7;
+		PutByte(value ? byte | 0x80 : byte);
+	} while (value);
+}
+
+static void PutString(const wchar_t* string)
+{
+	UINT length = (UINT)wcslen(string);
+	PutVarint(length);
+
+	for (UINT i = 0; i < length; i++)
+	{
+		PutVarint((UINT)string[i]);
+	}
+}
+
+static UINT64 GetVarint(const BYTE* data, UINT size, UINT* at)
+{
+	UINT64 value = 0;
+	int shift = 0;
+
+	while (*at < size)
+	{
+		BYTE byte = data[(*at)++];
+		value |= (UINT64)(byte & 0x7F) << shift;
+		shift += 7;
+
+		if (!(byte & 0x80))
+			break;
+	}
+
+	return value;
+}
+
+static void GetString(const BYTE* data, UINT size, UINT* at, wchar_t* string, UINT capacity)
+{
+	UINT length = (UINT)GetVarint(data, size, at);
+
+	for (UINT i = 0; i < length; i++)
+	{
+		wchar_t c = (wchar_t)GetVarint(data, size, at);
+		if (i < capacity - 1)
+			string[i] = c;
+	}
+
+	string[length < capacity - 1 ? length : capacity - 1] = L'\0';
+}
+
+static UINT ZigZag(int value)
+{
+	return ((UINT)value << 1) ^ (UINT)(value >> 31);
+}
+
+static int UnZigZag(UINT value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+static void FlushRecord(void)
+{
+	fwrite(History.Record, 1, History.RecordSize, History.Data);
+	History.DataSize += History.RecordSize;
+	History.RecordSize = 0;
+}
+
+static void BeginRecord(BYTE mask, UINT slot, UINT64 now)
+{
+	PutByte(mask);
+	PutVarint(now - History.LastRecord);
+	PutVarint(slot);
+	History.LastRecord = now;
+}
+
+static bool OpenHistory(void)
+{
+	char indexPath[512];
+	snprintf(indexPath, sizeof(indexPath), "%s.idx", History.Path);
+
+	History.Data = fopen(History.Path, "ab");
+	History.Index = fopen(indexPath, "ab");
+
+	if (History.Data == NULL || History.Index == NULL)
+	{
+		printf("Unable to open history %s\n", History.Path);
+		return false;
+	}
+
+	fseek(History.Data, 0, SEEK_END);
+	History.DataSize = (UINT)ftell(History.Data);
+	return true;
+}
+
+static void CloseHistory(void)
+{
+	if (History.Data)
+		fclose(History.Data);
+	if (History.Index)
+		fclose(History.Index);
+
+	History.Data = NULL;
+	History.Index = NULL;
+}
+
+static void RollHistory(void)
+{
+	CloseHistory();
+
+	char path[512];
+	char oldPath[512];
+
+	snprintf(oldPath, sizeof(oldPath), "%s.old", History.Path);
+	remove(oldPath);
+	rename(History.Path, oldPath);
+
+	snprintf(path, sizeof(path), "%s.idx", History.Path);
+	snprintf(oldPath, sizeof(oldPath), "%s.idx.old", History.Path);
+	remove(oldPath);
+	rename(path, oldPath);
+
+	OpenHistory();
+}
+
+static void BeginBlock(UINT64 now)
+{
+	if (History.DataSize >= HISTORY_MAX_BYTES)
+		RollHistory();
+
+	BYTE entry[12];
+	for (int i = 0; i < 8; i++)
+		entry[i] = (BYTE)(now >> (i * 8));
+	for (int i = 0; i < 4; i++)
+		entry[8 + i] = (BYTE)(History.DataSize >> (i * 8));
+
+	fwrite(entry, 1, sizeof(entry), History.Index);
+
+	PutByte(HISTORY_BLOCK);
+	PutVarint(now);
+	FlushRecord();
+
+	History.BlockStart = now;
+	History.LastRecord = now;
+}
+
+static BYTE DefaultRolesOf(DeviceInfo* info)
+{
+	BYTE roles = 0;
+	for (int role = 0; role < ERole_enum_count; role++)
+	{
+		if (IsDefaultDevice(info->Id, (ERole)role, info->DataFlow))
+			roles |= 1 << role;
+	}
+
+	return roles;
+}
+
+static void RecordDevice(UINT s, DeviceInfo* info, UINT64 now, bool keyframe)
+{
+	HistorySlot* slot = &History.Slots[s];
+
+	int volume = (int)(info->VolumeScalar * 1000.0f + 0.5f);
+	BYTE defaults = DefaultRolesOf(info);
+
+	BYTE mask = 0;
+	if (keyframe || !slot->Present)
+	{
+		mask = HISTORY_DEFINE | HISTORY_VOLUME | HISTORY_MUTE | HISTORY_STATE | HISTORY_DEFAULTS;
+		slot->Volume = 0;
+	}
+	else
+	{
+		if (volume != slot->Volume)
+			mask |= HISTORY_VOLUME;
+		if ((info->IsMute != 0) != (slot->IsMute != 0))
+			mask |= HISTORY_MUTE;
+		if (info->State != slot->State)
+			mask |= HISTORY_STATE;
+		if (defaults != slot->Defaults)
+			mask |= HISTORY_DEFAULTS;
+	}
+
+	if (mask == 0)
+		return;
+
+	if (info->IsMute)
+		mask |= HISTORY_MUTED;
+
+	BeginRecord(mask, s, now);
+
+	if (mask & HISTORY_DEFINE)
+	{
+		PutString(slot->Id);
+		PutString(StringText(info->Name));
+		PutByte((BYTE)info->DataFlow);
+	}
+	if (mask & HISTORY_VOLUME)
+		PutVarint(ZigZag(volume - slot->Volume));
+	if (mask & HISTORY_STATE)
+		PutVarint(info->State);
+	if (mask & HISTORY_DEFAULTS)
+		PutByte(defaults);
+
+	FlushRecord();
+
+	slot->Present = true;
+	slot->Volume = volume;
+	slot->IsMute = info->IsMute;
+	slot->State = info->State;
+	slot->Defaults = defaults;
+}
+
+static void SampleHistory(void)
+{
+	UINT64 now = GetWallClockMilliseconds();
+	bool keyframe = History.BlockStart == 0 || now - History.BlockStart >= HISTORY_BLOCK_MS;
+
+	if (keyframe)
+		BeginBlock(now);
+
+	InitializeAndPopulateAllDevices();
+
+	// Matched by Id text because string ids do not survive a refresh
+	if (History.SlotOfDeviceCapacity < NumDevices)
+	{
+		ArenaFree(History.SlotOfDevice);
+		History.SlotOfDeviceCapacity = DeviceCapacity;
+		History.SlotOfDevice = (int*)ArenaAlloc(History.SlotOfDeviceCapacity * sizeof(int));
+	}
+	memset(History.SlotOfDevice, 0xFF, NumDevices * sizeof(int));
+
+	for (UINT s = 0; s < History.NumSlots; s++)
+	{
+		HistorySlot* slot = &History.Slots[s];
+		int index = FindDeviceIndex(FindString(slot->Id));
+
+		if (index >= 0)
+		{
+			History.SlotOfDevice[index] = s;
+		}
+		else if (slot->Present)
+		{
+			BeginRecord(HISTORY_REMOVED, s, now);
+			FlushRecord();
+			slot->Present = false;
+		}
+	}
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		DeviceInfo* info = &AllDevices[i].Info;
+		int s = History.SlotOfDevice[i];
+
+		if (s < 0)
+		{
+			if (History.NumSlots == HISTORY_MAX_SLOTS)
+				continue;
+
+			s = History.NumSlots++;
+			wcsncpy(History.Slots[s].Id, StringText(info->Id), 127);
+		}
+
+		RecordDevice(s, info, now, keyframe);
+	}
+
+	fflush(History.Data);
+	fflush(History.Index);
+}
+
+static void StopHistoryHandler(int signal)
+{
+	InterlockedExchange(&StopHistory, 1);
+}
+
+static void RecordHistory(const char* path, int intervalSeconds)
+{
+	History.Path = path;
+	History.Slots = (HistorySlot*)ArenaAlloc(HISTORY_MAX_SLOTS * sizeof(HistorySlot));
+
+	if (!OpenHistory())
+		return;
+
+	signal(SIGINT, StopHistoryHandler);
+	printf("Recording device history to %s every %i s. Press Ctrl+C to stop.\n", path, intervalSeconds);
+
+	LONGLONG lastMetrics = GetTimestamp();
+
+	while (!StopHistory)
+	{
+		SampleHistory();
+
+		for (int waited = 0; waited < intervalSeconds * 10 && !StopHistory; waited++)
+		{
+			Sleep(100);
+			WriteMetricsEvery(&lastMetrics);
+		}
+	}
+
+	CloseHistory();
+	ArenaFree(History.Slots);
+	ArenaFree(History.SlotOfDevice);
+	printf("Stopped recording history.\n");
+}
+
+// Timeline query
+
+struct TimelineSlot {
+	// Runs appended to one file number their slots from 0 again, so a slot
+	// can hold a different device after a DEFINE
+	wchar_t Id[128];
+	wchar_t Name[128];
+	bool Matches;
+	bool Present;
+	bool Shown;
+	int Volume;
+	BOOL IsMute;
+	DWORD State;
+	BYTE Defaults;
+};
+
+static BYTE* ReadWholeFile(const char* path, UINT offset, UINT* size)
+{
+	*size = 0;
+
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	long end = ftell(file);
+	if (end <= (long)offset)
+	{
+		fclose(file);
+		return NULL;
+	}
+
+	*size = (UINT)(end - offset);
+	BYTE* data = (BYTE*)ArenaAlloc(*size);
+	fseek(file, offset, SEEK_SET);
+	fread(data, 1, *size, file);
+	fclose(file);
+
+	return data;
+}
+
+// Offset of the last block starting at or before since, from the index
+static UINT FindHistoryBlock(const char* indexPath, UINT64 since)
+{
+	UINT size;
+	BYTE* index = ReadWholeFile(indexPath, 0, &size);
+	if (index == NULL)
+		return 0;
+
+	UINT numEntries = size / 12;
+	UINT offset = 0;
+
+	// Block start times only increase, binary search for the last one <= since
+	UINT low = 0;
+	UINT high = numEntries;
+	while (low < high)
+	{
+		UINT middle = (low + high) / 2;
+		UINT64 start = 0;
+		for (int i = 0; i < 8; i++)
+			start |= (UINT64)index[middle * 12 + i] << (i * 8);
+
+		if (start <= since)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (low > 0)
+	{
+		BYTE* entry = index + (low - 1) * 12;
+		offset = entry[8] | (entry[9] << 8) | (entry[10] << 16) | ((UINT)entry[11] << 24);
+	}
+
+	ArenaFree(index);
+	return offset;
+}
+
+static void PrintTimelineTime(UINT64 milliseconds)
+{
+	time_t seconds = (time_t)(milliseconds / 1000);
+	char text[32];
+	strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+	printf("%s.%03u  ", text, (UINT)(milliseconds % 1000));
+}
+
+static int PrintTimelineFile(const char* path, const NamePattern* pattern, UINT64 since, TimelineSlot* slots)
+{
+	char indexPath[512];
+	snprintf(indexPath, sizeof(indexPath), "%s.idx", path);
+
+	UINT size;
+	BYTE* data = ReadWholeFile(path, FindHistoryBlock(indexPath, since), &size);
+	if (data == NULL)
+		return 0;
+
+	int printed = 0;
+	UINT64 now = 0;
+	UINT at = 0;
+
+	while (at < size)
+	{
+		BYTE mask = data[at++];
+
+		if (mask == HISTORY_BLOCK)
+		{
+			now = GetVarint(data, size, &at);
+			continue;
+		}
+
+		now += GetVarint(data, size, &at);
+		UINT s = (UINT)GetVarint(data, size, &at);
+		if (s >= HISTORY_MAX_SLOTS)
+			break;
+
+		TimelineSlot* slot = &slots[s];
+		wchar_t id[128];
+		EDataFlow dataFlow = eRender;
+		bool repeated = false;
+
+		if (mask & HISTORY_DEFINE)
+		{
+			GetString(data, size, &at, id, 128);
+			GetString(data, size, &at, slot->Name, 128);
+			dataFlow = (EDataFlow)data[at++];
+
+			slot->Matches = MatchName(pattern, InternString(slot->Name));
+
+			// Only the same device is a repeat, another one starts over
+			repeated = slot->Shown && slot->Present && wcscmp(id, slot->Id) == 0;
+			if (!repeated)
+				slot->Shown = false;
+			wcscpy(slot->Id, id);
+		}
+
+		int volume = mask & HISTORY_DEFINE ? 0 : slot->Volume;
+		if (mask & HISTORY_VOLUME)
+			volume += UnZigZag((UINT)GetVarint(data, size, &at));
+		BOOL isMute = mask & HISTORY_MUTE ? (mask & HISTORY_MUTED) != 0 : slot->IsMute;
+		DWORD state = mask & HISTORY_STATE ? (DWORD)GetVarint(data, size, &at) : slot->State;
+		BYTE defaults = mask & HISTORY_DEFAULTS ? data[at++] : slot->Defaults;
+
+		// A keyframe repeats a device that is already on screen, only show
+		// what changed since its last record
+		if (repeated)
+		{
+			mask = 0;
+			if (volume != slot->Volume)
+				mask |= HISTORY_VOLUME;
+			if (isMute != slot->IsMute)
+				mask |= HISTORY_MUTE | (isMute ? HISTORY_MUTED : 0);
+			if (state != slot->State)
+				mask |= HISTORY_STATE;
+			if (defaults != slot->Defaults)
+				mask |= HISTORY_DEFAULTS;
+		}
+
+		slot->Present = !(mask & HISTORY_REMOVED);
+		slot->Volume = volume;
+		slot->IsMute = isMute;
+		slot->State = state;
+		slot->Defaults = defaults;
+
+		if (!slot->Matches || now < since || mask == 0)
+			continue;
+
+		slot->Shown = true;
+
+		PrintTimelineTime(now);
+		printf("%-40ls", slot->Name);
+
+		if (mask & HISTORY_REMOVED)
+			printf("  removed");
+		if (mask & HISTORY_DEFINE)
+			printf("  %s", dataFlow == eCapture ? "Recording" : "Playback");
+		if (mask & HISTORY_VOLUME)
+			printf("  volume %i%%", (volume + 5) / 10);
+		if (mask & HISTORY_MUTE)
+			printf("  %s", BoolToString(mask & HISTORY_MUTED));
+		if (mask & HISTORY_STATE)
+			printf("  %s", DwordToString(state));
+		if (mask & HISTORY_DEFAULTS)
+		{
+			printf("  default:");
+			if (defaults == 0)
+				printf(" none");
+			if (defaults & (1 << eConsole))
+				printf(" console");
+			if (defaults & (1 << eMultimedia))
+				printf(" multimedia");
+			if (defaults & (1 << eCommunications))
+				printf(" communications");
+		}
+
+		printf("\n");
+		printed++;
+	}
+
+	ArenaFree(data);
+	return printed;
+}
+
+static void PrintTimeline(const char* path, const wchar_t* devicePattern, int minutes)
+{
+	UINT64 since = minutes > 0 ? GetWallClockMilliseconds() - (UINT64)minutes * 60000 : 0;
+	NamePattern pattern = MakeNamePattern(devicePattern);
+	ReserveStrings(HISTORY_MAX_SLOTS, HISTORY_MAX_SLOTS * 64);
+
+	// Slots are numbered the same in both files, the older one is read first
+	TimelineSlot* slots = (TimelineSlot*)ArenaAlloc(HISTORY_MAX_SLOTS * sizeof(TimelineSlot));
+
+	char oldPath[512];
+	snprintf(oldPath, sizeof(oldPath), "%s.old", path);
+
+	int printed = PrintTimelineFile(oldPath, &pattern, since, slots);
+	printed += PrintTimelineFile(path, &pattern, since, slots);
+
+	if (printed == 0)
+		printf("No history for %ls in %s\n", devicePattern, path);
+
+	ArenaFree(slots);
+}
@@ -0,0 +1,430 @@
+// Idle detection, run with -idle <clause> <seconds> [duck dB].
+//
+// Every active endpoint matching the clause gets a level stream: a loopback
+// of render endpoints and the signal of recording endpoints, written to a
+// ring by a backend thread. The main thread is the only processing thread.
+// Every IDLE_WINDOW_MS it measures what each ring received and mutes, or
+// ducks by the given dB, an endpoint that has stayed below the threshold
+// for the idle time. When signal returns it restores the volume and mute
+// the endpoint had.
+//
+// Streams tapped after the endpoint gain (PostGain) are never muted, since
+// the signal coming back would be muted too. They are ducked by
+// IDLE_MUTE_DUCK_DB instead, and their levels are measured with the duck
+// taken back out. Capture endpoints and every PulseAudio stream are
+// PostGain. WASAPI loopback is not, it taps the mix before the render
+// endpoint's volume and mute, so Windows render endpoints are muted.
+//
+// -idle-test runs the same processing on synthetic devices fed synthetic
+// PCM in simulated time, and checks when every device is silenced and
+// restored.
+
+#define IDLE_WINDOW_MS 100
+#define IDLE_THRESHOLD_DB -60.0f
+#define IDLE_PEAK_THRESHOLD_DB -40.0f
+#define IDLE_MUTE_DUCK_DB 40.0f
+
+// Below any float signal, so silence still has a finite level
+#define IDLE_FLOOR_DB -200.0f
+
+struct IdleMonitor {
+	LevelStream* Streams;
+	int NumStreams;
+	double IdleMilliseconds;
+
+	// 0 mutes
+	float DuckDb;
+	bool Quiet;
+};
+
+static IdleMonitor Idle;
+static volatile LONG StopIdle;
+
+static float LevelToDb(float level)
+{
+	return level > 0.0f ? fmaxf(20.0f * log10f(level), IDLE_FLOOR_DB) : IDLE_FLOOR_DB;
+}
+
+static void SilenceStream(LevelStream* stream, double now)
+{
+	Device* device = &AllDevices[stream->DeviceIndex];
+
+	// The user may have changed it since enumeration
+	EndpointReadVolume(device);
+	stream->SavedLevel = device->Info.VolumeLevel;
+	stream->SavedMute = device->Info.IsMute;
+	stream->Silenced = true;
+
+	if (Idle.DuckDb == 0.0f && !stream->PostGain)
+	{
+		QueueMute(device, TRUE);
+	}
+	else
+	{
+		float duckDb = Idle.DuckDb > 0.0f ? Idle.DuckDb : IDLE_MUTE_DUCK_DB;
+		QueueVolumeLevel(device, stream->SavedLevel - duckDb);
+	}
+
+	if (!Idle.Quiet)
+		printf("%8.1f s  %ls silent for %.0f s\n", now / 1000.0, StringText(device->Info.Name), (now - stream->LastSignal) / 1000.0);
+}
+
+static void RestoreStream(LevelStream* stream)
+{
+	Device* device = &AllDevices[stream->DeviceIndex];
+
+	// Info holds what was written when silencing, not what the endpoint has
+	// now, so the restore is always written
+	device->Info.HasVolume = false;
+	QueueVolumeLevel(device, stream->SavedLevel);
+	QueueMute(device, stream->SavedMute);
+	stream->Silenced = false;
+}
+
+// One window of every stream, now is in milliseconds
+static void ProcessIdleStreams(double now)
+{
+	for (int i = 0; i < Idle.NumStreams; i++)
+	{
+		LevelStream* stream = &Idle.Streams[i];
+
+		// No samples is silence, loopback delivers nothing while nothing plays
+		LevelSums sums = {};
+		ConsumeRing(&stream->Ring, &sums);
+
+		float rms = sums.Count > 0 ? (float)sqrt(sums.SumSquares / sums.Count) : 0.0f;
+		stream->LevelDb = LevelToDb(rms) + stream->DuckedDb;
+		stream->PeakDb = LevelToDb(sums.Peak) + stream->DuckedDb;
+
+		if (stream->LevelDb > IDLE_THRESHOLD_DB || stream->PeakDb > IDLE_PEAK_THRESHOLD_DB)
+		{
+			stream->LastSignal = now;
+			if (stream->Silenced)
+			{
+				RestoreStream(stream);
+				if (!Idle.Quiet)
+					printf("%8.1f s  %ls signal at %.1f dBFS, restored\n", now / 1000.0, StringText(AllDevices[stream->DeviceIndex].Info.Name), stream->LevelDb);
+			}
+		}
+		else if (!stream->Silenced && now - stream->LastSignal >= Idle.IdleMilliseconds)
+		{
+			SilenceStream(stream, now);
+		}
+	}
+
+	FlushCommands();
+
+	// The duck that actually landed is what the next window takes back out
+	for (int i = 0; i < Idle.NumStreams; i++)
+	{
+		LevelStream* stream = &Idle.Streams[i];
+		DeviceInfo* info = &AllDevices[stream->DeviceIndex].Info;
+		stream->DuckedDb = stream->PostGain && stream->Silenced ? stream->SavedLevel - info->VolumeLevel : 0.0f;
+	}
+}
+
+static void AddIdleStream(int deviceIndex)
+{
+	LevelStream* stream = &Idle.Streams[Idle.NumStreams++];
+	stream->DeviceIndex = deviceIndex;
+	stream->Ring.Samples = (float*)ArenaAlloc(LEVEL_RING_SAMPLES * sizeof(float));
+}
+
+static void ReleaseIdleStreams(void)
+{
+	for (int i = 0; i < Idle.NumStreams; i++)
+	{
+		ArenaFree(Idle.Streams[i].Ring.Samples);
+	}
+
+	ArenaFree(Idle.Streams);
+	Idle.Streams = NULL;
+	Idle.NumStreams = 0;
+}
+
+static void StopIdleHandler(int signal)
+{
+	InterlockedExchange(&StopIdle, 1);
+}
+
+static void RunIdleMonitor(const wchar_t* pattern, int idleSeconds, float duckDb)
+{
+	// Level streams need live endpoints behind them
+	if (Trace.Mode == TraceMode_Replay)
+	{
+		printf("-idle measures live endpoints and cannot replay a trace\n");
+		return;
+	}
+
+	NamePattern namePattern = MakeNamePattern(pattern);
+
+	Idle.IdleMilliseconds = idleSeconds * 1000.0;
+	Idle.DuckDb = duckDb;
+	Idle.Streams = (LevelStream*)ArenaAlloc(NumDevices * sizeof(LevelStream));
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		Device* device = &AllDevices[i];
+		if (device->Info.State != DEVICE_STATE_ACTIVE || !MatchName(&namePattern, device->Info.Name))
+			continue;
+
+		AddIdleStream(i);
+		LevelStream* stream = &Idle.Streams[Idle.NumStreams - 1];
+
+		if (!PlatformStartLevelStream(device, stream))
+		{
+			// The slot is reused, nothing was written to its ring
+			printf("Unable to measure %ls\n", StringText(device->Info.Name));
+			ArenaFree(stream->Ring.Samples);
+			Idle.NumStreams--;
+		}
+	}
+
+	if (Idle.NumStreams == 0)
+	{
+		printf("No active devices match %ls\n", pattern);
+		ReleaseIdleStreams();
+		return;
+	}
+
+	signal(SIGINT, StopIdleHandler);
+	printf("Watching %d devices, silencing after %d s below %.0f dBFS. Press Ctrl+C to stop.\n",
+		Idle.NumStreams, idleSeconds, IDLE_THRESHOLD_DB);
+
+	LONGLONG start = GetTimestamp();
+	LONGLONG lastMetrics = start;
+
+	while (!StopIdle)
+	{
+		Sleep(IDLE_WINDOW_MS);
+		ProcessIdleStreams(MillisecondsSince(start));
+		WriteMetricsEvery(&lastMetrics);
+	}
+
+	for (int i = 0; i < Idle.NumStreams; i++)
+	{
+		LevelStream* stream = &Idle.Streams[i];
+		PlatformStopLevelStream(stream);
+
+		if (stream->Silenced)
+		{
+			RestoreStream(stream);
+			printf("%ls restored\n", StringText(AllDevices[stream->DeviceIndex].Info.Name));
+		}
+		if (stream->Ring.Dropped > 0)
+			printf("%ls dropped %d samples\n", StringText(AllDevices[stream->DeviceIndex].Info.Name), stream->Ring.Dropped);
+	}
+
+	FlushCommands();
+	ReleaseIdleStreams();
+	printf("Stopped watching for idle devices.\n");
+}
+
+// Synthetic test
+
+#define IDLE_TEST_DEVICES 40
+#define IDLE_TEST_MILLISECONDS 8000
+#define IDLE_TEST_RETURN_MS 5000
+#define IDLE_TEST_PACKET_SAMPLES 480
+
+static bool TestLevelKernels(void)
+{
+	float samples[1031];
+	for (int i = 0; i < 1031; i++)
+	{
+		samples[i] = (float)((rand() % 20001) - 10000) / 10000.0f;
+	}
+
+	// Every length and alignment through the vector loops and their tails
+	for (int offset = 0; offset < 8; offset++)
+	{
+		for (int count = 0; count + offset <= 1031; count += 37)
+		{
+			LevelSums expected = {};
+			LevelSums measured = {};
+			MeasureLevelsScalar(samples + offset, count, &expected);
+			MeasureLevels(samples + offset, count, &measured);
+
+			if (measured.Count != expected.Count || measured.Peak != expected.Peak ||
+				fabs(measured.SumSquares - expected.SumSquares) > 1e-3 * (expected.SumSquares + 1.0))
+			{
+				printf("Level kernel differs at offset %d, count %d\n", offset, count);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool TestSampleRing(void)
+{
+	SampleRing ring = {};
+	ring.Samples = (float*)ArenaAlloc(LEVEL_RING_SAMPLES * sizeof(float));
+
+	float packet[IDLE_TEST_PACKET_SAMPLES];
+	for (int i = 0; i < IDLE_TEST_PACKET_SAMPLES; i++)
+	{
+		packet[i] = 0.5f;
+	}
+
+	// Wraps the positions several times in packets that straddle the end
+	bool passed = true;
+	for (int round = 0; round < 2000 && passed; round++)
+	{
+		WriteRing(&ring, packet, IDLE_TEST_PACKET_SAMPLES);
+		WriteRing(&ring, NULL, IDLE_TEST_PACKET_SAMPLES);
+
+		LevelSums sums = {};
+		ConsumeRing(&ring, &sums);
+		passed = sums.Count == 2 * IDLE_TEST_PACKET_SAMPLES && sums.Peak == 0.5f;
+	}
+
+	// A full ring keeps what it has and counts the rest
+	UINT written = 0;
+	while (written < LEVEL_RING_SAMPLES + IDLE_TEST_PACKET_SAMPLES)
+	{
+		WriteRing(&ring, packet, IDLE_TEST_PACKET_SAMPLES);
+		written += IDLE_TEST_PACKET_SAMPLES;
+	}
+
+	LevelSums sums = {};
+	ConsumeRing(&ring, &sums);
+	passed = passed && sums.Count == LEVEL_RING_SAMPLES && (UINT)ring.Dropped == written - LEVEL_RING_SAMPLES;
+
+	ArenaFree(ring.Samples);
+
+	if (!passed)
+		printf("Sample ring lost or invented samples\n");
+	return passed;
+}
+
+// Fills one window of a synthetic stream, as heard through the endpoint gain
+// when the stream is tapped after it
+static void WriteSyntheticWindow(LevelStream* stream, double windowStart, double toneEnd, float initialLevel)
+{
+	DeviceInfo* info = &AllDevices[stream->DeviceIndex].Info;
+	bool tone = windowStart < toneEnd || ((stream->DeviceIndex % 2) == 0 && windowStart >= IDLE_TEST_RETURN_MS);
+
+	float gain = 1.0f;
+	if (stream->PostGain)
+		gain = info->IsMute ? 0.0f : powf(10.0f, (info->VolumeLevel - initialLevel) / 20.0f);
+
+	float packet[IDLE_TEST_PACKET_SAMPLES];
+	UINT samples = stream->SampleRate / 1000 * IDLE_WINDOW_MS * stream->Channels;
+
+	for (UINT written = 0; written < samples; written += IDLE_TEST_PACKET_SAMPLES)
+	{
+		// A quiet tone, -43 dBFS RMS, that a 40 dB duck would hide if it
+		// were not taken back out, over a -80 dBFS noise floor
+		for (int i = 0; i < IDLE_TEST_PACKET_SAMPLES; i++)
+		{
+			float noise = 0.0001f * (float)((rand() % 2001) - 1000) / 1000.0f;
+			float sample = tone ? 0.01f * sinf((float)(written + i) * 0.0576f) : noise;
+			packet[i] = sample * gain;
+		}
+
+		WriteRing(&stream->Ring, packet, IDLE_TEST_PACKET_SAMPLES);
+	}
+}
+
+static bool RunIdleScenario(float duckDb)
+{
+	StartSyntheticDevices(IDLE_TEST_DEVICES);
+	InitializeAndPopulateAllDevices();
+
+	Idle.IdleMilliseconds = 1000.0;
+	Idle.DuckDb = duckDb;
+	Idle.Quiet = true;
+	Idle.Streams = (LevelStream*)ArenaAlloc(NumDevices * sizeof(LevelStream));
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		if (AllDevices[i].Info.State != DEVICE_STATE_ACTIVE)
+			continue;
+
+		AddIdleStream(i);
+		LevelStream* stream = &Idle.Streams[Idle.NumStreams - 1];
+		stream->Channels = 2;
+		stream->SampleRate = 48000;
+		stream->PostGain = (i / 2) % 2 == 1;
+	}
+
+	double silencedAt[IDLE_TEST_DEVICES] = {};
+	double restoredAt[IDLE_TEST_DEVICES] = {};
+	float initialLevel = AllDevices[0].Info.VolumeLevel;
+
+	for (double now = IDLE_WINDOW_MS; now <= IDLE_TEST_MILLISECONDS; now += IDLE_WINDOW_MS)
+	{
+		for (int s = 0; s < Idle.NumStreams; s++)
+		{
+			LevelStream* stream = &Idle.Streams[s];
+			double toneEnd = 500.0 + (stream->DeviceIndex % 4) * 500.0;
+			WriteSyntheticWindow(stream, now - IDLE_WINDOW_MS, toneEnd, initialLevel);
+		}
+
+		ProcessIdleStreams(now);
+
+		for (int s = 0; s < Idle.NumStreams; s++)
+		{
+			LevelStream* stream = &Idle.Streams[s];
+			if (stream->Silenced && silencedAt[stream->DeviceIndex] == 0.0)
+				silencedAt[stream->DeviceIndex] = now;
+			if (!stream->Silenced && silencedAt[stream->DeviceIndex] != 0.0 && restoredAt[stream->DeviceIndex] == 0.0)
+				restoredAt[stream->DeviceIndex] = now;
+		}
+	}
+
+	bool passed = true;
+	for (int s = 0; s < Idle.NumStreams; s++)
+	{
+		LevelStream* stream = &Idle.Streams[s];
+		int d = stream->DeviceIndex;
+		DeviceInfo* info = &AllDevices[d].Info;
+
+		// The last window with tone ends at toneEnd, restoring takes the
+		// first window of the returning tone
+		double toneEnd = 500.0 + (d % 4) * 500.0;
+		double expectedSilence = toneEnd + Idle.IdleMilliseconds;
+		double expectedRestore = d % 2 == 0 ? IDLE_TEST_RETURN_MS + IDLE_WINDOW_MS : 0.0;
+
+		bool muted = duckDb == 0.0f && !stream->PostGain;
+		float duck = duckDb > 0.0f ? duckDb : IDLE_MUTE_DUCK_DB;
+		bool silencedNow = d % 2 == 1;
+		bool state = silencedNow && muted ? info->IsMute && info->VolumeLevel == initialLevel :
+			silencedNow ? !info->IsMute && info->VolumeLevel == initialLevel - duck :
+			!info->IsMute && info->VolumeLevel == initialLevel;
+
+		if (silencedAt[d] != expectedSilence || restoredAt[d] != expectedRestore || !state)
+		{
+			printf("  %ls: silenced at %.0f ms (expected %.0f), restored at %.0f ms (expected %.0f), mute %d, level %.1f\n",
+				StringText(info->Name), silencedAt[d], expectedSilence, restoredAt[d], expectedRestore, info->IsMute, info->VolumeLevel);
+			passed = false;
+		}
+	}
+
+	ReleaseIdleStreams();
+	ReleaseAllDevices();
+	return passed;
+}
+
+static bool RunIdleTest(void)
+{
+	bool passed = true;
+
+	bool kernels = TestLevelKernels();
+	printf("%-28s%s\n", "level kernels", kernels ? "passed" : "FAILED");
+
+	bool ring = TestSampleRing();
+	printf("%-28s%s\n", "sample ring", ring ? "passed" : "FAILED");
+
+	bool muting = RunIdleScenario(0.0f);
+	printf("%-28s%s\n", "mute idle devices", muting ? "passed" : "FAILED");
+
+	bool ducking = RunIdleScenario(20.0f);
+	printf("%-28s%s\n", "duck idle devices", ducking ? "passed" : "FAILED");
+
+	passed = kernels && ring && muting && ducking;
+	printf("\n%s\n", passed ? "Idle test passed." : "Idle test FAILED.");
+	return passed;
+}
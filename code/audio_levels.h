@@ -0,0 +1,222 @@
+#pragma once
+
+// Signal levels of endpoint streams, for -idle.
+//
+// A backend capture thread writes each stream's interleaved float samples
+// into a SampleRing, and the processing thread measures whatever arrived
+// since its last pass. The ring has one producer and one consumer: the
+// capture thread only moves Write and the processing thread only moves
+// Read, so neither takes a lock. Positions count samples and wrap through
+// unsigned arithmetic, and the capacity is a power of two.
+//
+// MeasureLevels sums squares for RMS and tracks the absolute peak a vector
+// at a time, with AVX2 when available, SSE2 otherwise and plain C off x64.
+
+#include "audio_search.h"
+
+// About 1.3 s of 48 kHz stereo, enough for the processing thread to miss
+// several passes
+#define LEVEL_RING_SAMPLES (1 << 17)
+
+struct LevelSums {
+	double SumSquares;
+	float Peak;
+	UINT Count;
+};
+
+static void MeasureLevelsScalar(const float* samples, int count, LevelSums* sums)
+{
+	float sumSquares = 0.0f;
+	float peak = sums->Peak;
+
+	for (int i = 0; i < count; i++)
+	{
+		float sample = samples[i];
+		sumSquares += sample * sample;
+
+		float magnitude = fabsf(sample);
+		if (magnitude > peak)
+			peak = magnitude;
+	}
+
+	sums->SumSquares += sumSquares;
+	sums->Peak = peak;
+	sums->Count += count;
+}
+
+#ifdef WIDE_SEARCH_SIMD
+
+static float HorizontalSum128(__m128 vector)
+{
+	__m128 high = _mm_movehl_ps(vector, vector);
+	__m128 pairs = _mm_add_ps(vector, high);
+	return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+static float HorizontalMax128(__m128 vector)
+{
+	__m128 high = _mm_movehl_ps(vector, vector);
+	__m128 pairs = _mm_max_ps(vector, high);
+	return _mm_cvtss_f32(_mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+static void MeasureLevelsSSE2(const float* samples, int count, LevelSums* sums)
+{
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	// Two accumulators hide the latency of the adds
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	__m128 peak = _mm_set1_ps(sums->Peak);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 block0 = _mm_loadu_ps(samples + i);
+		__m128 block1 = _mm_loadu_ps(samples + i + 4);
+
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(block0, block0));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(block1, block1));
+		peak = _mm_max_ps(peak, _mm_and_ps(block0, absMask));
+		peak = _mm_max_ps(peak, _mm_and_ps(block1, absMask));
+	}
+
+	sums->SumSquares += HorizontalSum128(_mm_add_ps(sum0, sum1));
+	sums->Peak = HorizontalMax128(peak);
+	sums->Count += i;
+
+	MeasureLevelsScalar(samples + i, count - i, sums);
+}
+
+TARGET_AVX2 static void MeasureLevelsAVX2(const float* samples, int count, LevelSums* sums)
+{
+	__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	__m256 peak = _mm256_set1_ps(sums->Peak);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256 block0 = _mm256_loadu_ps(samples + i);
+		__m256 block1 = _mm256_loadu_ps(samples + i + 8);
+
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(block0, block0));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(block1, block1));
+		peak = _mm256_max_ps(peak, _mm256_and_ps(block0, absMask));
+		peak = _mm256_max_ps(peak, _mm256_and_ps(block1, absMask));
+	}
+
+	__m256 sum = _mm256_add_ps(sum0, sum1);
+	sums->SumSquares += HorizontalSum128(_mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+	sums->Peak = HorizontalMax128(_mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1)));
+	sums->Count += i;
+
+	// The SSE2 loop takes the remainder a smaller vector at a time
+	MeasureLevelsSSE2(samples + i, count - i, sums);
+}
+
+#endif
+
+// Picked once, like the FindWide kernel
+static WideSearchLevel LevelKernel;
+
+// Adds count samples to sums
+static void MeasureLevels(const float* samples, int count, LevelSums* sums)
+{
+	if (count <= 0)
+		return;
+
+#ifdef WIDE_SEARCH_SIMD
+	if (LevelKernel == WideSearch_Unknown)
+		LevelKernel = HasAVX2() ? WideSearch_AVX2 : WideSearch_SSE2;
+
+	if (LevelKernel == WideSearch_AVX2)
+		MeasureLevelsAVX2(samples, count, sums);
+	else
+		MeasureLevelsSSE2(samples, count, sums);
+#else
+	MeasureLevelsScalar(samples, count, sums);
+#endif
+}
+
+struct SampleRing {
+	float* Samples;
+	volatile LONG Write;
+	volatile LONG Read;
+
+	// Samples the capture thread could not fit, written by it alone
+	volatile LONG Dropped;
+};
+
+// Capture thread only. NULL samples write silence.
+static void WriteRing(SampleRing* ring, const float* samples, UINT count)
+{
+	UINT write = (UINT)ring->Write;
+	UINT read = (UINT)ReadAcquire(&ring->Read);
+	UINT space = LEVEL_RING_SAMPLES - (write - read);
+
+	// A stalled reader loses the newest samples rather than blocking capture
+	if (count > space)
+	{
+		WriteRelease(&ring->Dropped, ring->Dropped + (LONG)(count - space));
+		count = space;
+	}
+
+	UINT at = write & (LEVEL_RING_SAMPLES - 1);
+	UINT first = count < LEVEL_RING_SAMPLES - at ? count : LEVEL_RING_SAMPLES - at;
+
+	if (samples)
+	{
+		memcpy(ring->Samples + at, samples, first * sizeof(float));
+		memcpy(ring->Samples, samples + first, (count - first) * sizeof(float));
+	}
+	else
+	{
+		memset(ring->Samples + at, 0, first * sizeof(float));
+		memset(ring->Samples, 0, (count - first) * sizeof(float));
+	}
+
+	WriteRelease(&ring->Write, (LONG)(write + count));
+}
+
+// Processing thread only. Measures every sample written since the last call
+// in place and frees them.
+static void ConsumeRing(SampleRing* ring, LevelSums* sums)
+{
+	UINT read = (UINT)ring->Read;
+	UINT write = (UINT)ReadAcquire(&ring->Write);
+	UINT count = write - read;
+
+	UINT at = read & (LEVEL_RING_SAMPLES - 1);
+	UINT first = count < LEVEL_RING_SAMPLES - at ? count : LEVEL_RING_SAMPLES - at;
+
+	MeasureLevels(ring->Samples + at, (int)first, sums);
+	MeasureLevels(ring->Samples, (int)(count - first), sums);
+
+	WriteRelease(&ring->Read, (LONG)write);
+}
+
+struct LevelStream {
+	SampleRing Ring;
+	int DeviceIndex;
+
+	// Set by the backend when the stream starts. PostGain streams are tapped
+	// after the endpoint volume and mute, so muting them would hide the
+	// signal coming back.
+	int Channels;
+	DWORD SampleRate;
+	bool PostGain;
+
+	// Processing thread state
+	float LevelDb;
+	float PeakDb;
+	double LastSignal;
+	bool Silenced;
+	float SavedLevel;
+	BOOL SavedMute;
+	float DuckedDb;
+
+	PlatformLevelStream Platform;
+};
@@ -0,0 +1,157 @@
+// Call counters and latency histograms per endpoint operation.
+//
+// Every endpoint call adds to its operation's call count, failure count
+// and latency histogram with interlocked increments, so session threads
+// and notification callbacks can record without a lock. Replayed calls
+// record the latency they reproduce and the recorded result. With -metrics
+// <file> the totals are written in Prometheus text format when the command
+// exits, and every METRICS_INTERVAL_MS while -watch, -history or -idle is
+// running. The file is written next to the target and renamed over it so a
+// scraper never reads a partial file.
+
+enum MetricOp {
+	Metric_Enumerate,
+	Metric_Activate,
+	Metric_GetVolume,
+	Metric_SetVolume,
+	Metric_SetMute,
+	Metric_GetDefault,
+	Metric_SetDefault,
+	Metric_SetVisibility,
+	Metric_UpdateState,
+	Metric_ReadDetails,
+	Metric_QueryFormat,
+	Metric_SetSessionVolume,
+	Metric_SetSessionMute,
+	Metric_Count
+};
+
+static const char* MetricOpNames[Metric_Count] = {
+	"enumerate",
+	"activate",
+	"get_volume",
+	"set_volume",
+	"set_mute",
+	"get_default",
+	"set_default",
+	"set_visibility",
+	"update_state",
+	"read_details",
+	"query_format",
+	"set_session_volume",
+	"set_session_mute",
+};
+
+// Upper bounds in microseconds, the last bucket is +Inf
+#define METRIC_BUCKETS 12
+static const LONG MetricBucketBounds[METRIC_BUCKETS] = {
+	50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+
+#define METRICS_INTERVAL_MS 10000
+
+struct OperationMetrics {
+	volatile LONG Calls;
+	volatile LONG Failures;
+	volatile LONGLONG TotalMicroseconds;
+	volatile LONG Buckets[METRIC_BUCKETS + 1];
+};
+
+struct MetricsState {
+	const char* Path;
+	OperationMetrics Operations[Metric_Count];
+};
+
+static MetricsState Metrics;
+
+static void RecordMetric(MetricOp op, LONGLONG start, HRESULT result)
+{
+	LONG microseconds = (LONG)(MillisecondsSince(start) * 1000.0);
+	OperationMetrics* metrics = &Metrics.Operations[op];
+
+	int bucket = 0;
+	while (bucket < METRIC_BUCKETS && microseconds > MetricBucketBounds[bucket])
+		bucket++;
+
+	InterlockedIncrement(&metrics->Calls);
+	InterlockedIncrement(&metrics->Buckets[bucket]);
+	InterlockedExchangeAdd64(&metrics->TotalMicroseconds, microseconds);
+
+	if (FAILED(result))
+		InterlockedIncrement(&metrics->Failures);
+}
+
+static void WriteMetricsTo(FILE* file)
+{
+	fprintf(file, "# HELP caudiodevices_endpoint_calls_total Endpoint calls by operation.\n");
+	fprintf(file, "# TYPE caudiodevices_endpoint_calls_total counter\n");
+	for (int op = 0; op < Metric_Count; op++)
+	{
+		fprintf(file, "caudiodevices_endpoint_calls_total{op=\"%s\"} %d\n", MetricOpNames[op], Metrics.Operations[op].Calls);
+	}
+
+	fprintf(file, "# HELP caudiodevices_endpoint_failures_total Endpoint calls that returned a failure HRESULT.\n");
+	fprintf(file, "# TYPE caudiodevices_endpoint_failures_total counter\n");
+	for (int op = 0; op < Metric_Count; op++)
+	{
+		fprintf(file, "caudiodevices_endpoint_failures_total{op=\"%s\"} %d\n", MetricOpNames[op], Metrics.Operations[op].Failures);
+	}
+
+	fprintf(file, "# HELP caudiodevices_endpoint_latency_seconds Endpoint call latency.\n");
+	fprintf(file, "# TYPE caudiodevices_endpoint_latency_seconds histogram\n");
+	for (int op = 0; op < Metric_Count; op++)
+	{
+		OperationMetrics* metrics = &Metrics.Operations[op];
+		const char* name = MetricOpNames[op];
+
+		// Buckets are stored individually and exported cumulative
+		LONG cumulative = 0;
+		for (int bucket = 0; bucket < METRIC_BUCKETS; bucket++)
+		{
+			cumulative += metrics->Buckets[bucket];
+			fprintf(file, "caudiodevices_endpoint_latency_seconds_bucket{op=\"%s\",le=\"%g\"} %d\n",
+				name, MetricBucketBounds[bucket] / 1000000.0, cumulative);
+		}
+
+		cumulative += metrics->Buckets[METRIC_BUCKETS];
+		fprintf(file, "caudiodevices_endpoint_latency_seconds_bucket{op=\"%s\",le=\"+Inf\"} %d\n", name, cumulative);
+		fprintf(file, "caudiodevices_endpoint_latency_seconds_sum{op=\"%s\"} %.6f\n", name, metrics->TotalMicroseconds / 1000000.0);
+		fprintf(file, "caudiodevices_endpoint_latency_seconds_count{op=\"%s\"} %d\n", name, cumulative);
+	}
+}
+
+static void WriteMetrics(void)
+{
+	if (Metrics.Path == NULL)
+		return;
+
+	char temporaryPath[512];
+	snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", Metrics.Path);
+
+	FILE* file = fopen(temporaryPath, "w");
+	if (file == NULL)
+	{
+		printf("Unable to write metrics to %s\n", temporaryPath);
+		return;
+	}
+
+	WriteMetricsTo(file);
+	fclose(file);
+
+#ifdef _WIN32
+	MoveFileExA(temporaryPath, Metrics.Path, MOVEFILE_REPLACE_EXISTING);
+#else
+	rename(temporaryPath, Metrics.Path);
+#endif
+}
+
+// For long-running modes, called from their loops. last is when the metrics
+// were last written.
+static void WriteMetricsEvery(LONGLONG* last)
+{
+	if (Metrics.Path && MillisecondsSince(*last) >= METRICS_INTERVAL_MS)
+	{
+		WriteMetrics();
+		*last = GetTimestamp();
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+// Preset patterns compiled at build time.
+// A pattern is literal segments separated by stars. CompilePattern splits it
+// into segment offsets while compiling, so matching a device name is a
+// sequence of substring searches with no per-character pattern decoding.
+// PRESET_PATTERN rejects malformed patterns with a build error: empty
+// patterns, patterns that are only stars, repeated stars and patterns with
+// more than MAX_PATTERN_SEGMENTS segments.
+
+#include "audio_search.h"
+
+#define MAX_PATTERN_SEGMENTS 8
+
+struct PatternSegment {
+	int Offset;
+	int Length;
+};
+
+struct CompiledPattern {
+	const wchar_t* Text;
+	PatternSegment Segments[MAX_PATTERN_SEGMENTS];
+	int NumSegments;
+
+	// No leading or trailing star, the first or last segment is pinned
+	bool AnchoredStart;
+	bool AnchoredEnd;
+};
+
+constexpr bool IsValidPattern(const wchar_t* pattern)
+{
+	if (pattern[0] == L'\0')
+		return false;
+
+	int segments = 0;
+	for (int i = 0; pattern[i] != L'\0'; i++)
+	{
+		if (pattern[i] == L'*' && pattern[i + 1] == L'*')
+			return false;
+		if (pattern[i] != L'*' && (i == 0 || pattern[i - 1] == L'*'))
+			segments++;
+	}
+
+	return segments > 0 && segments <= MAX_PATTERN_SEGMENTS;
+}
+
+constexpr CompiledPattern CompilePattern(const wchar_t* pattern)
+{
+	CompiledPattern result = {};
+	result.Text = pattern;
+
+	int length = 0;
+	while (pattern[length] != L'\0')
+		length++;
+
+	result.AnchoredStart = length > 0 && pattern[0] != L'*';
+	result.AnchoredEnd = length > 0 && pattern[length - 1] != L'*';
+
+	int i = 0;
+	while (i < length && result.NumSegments < MAX_PATTERN_SEGMENTS)
+	{
+		if (pattern[i] == L'*')
+		{
+			i++;
+			continue;
+		}
+
+		int start = i;
+		while (i < length && pattern[i] != L'*')
+			i++;
+
+		result.Segments[result.NumSegments].Offset = start;
+		result.Segments[result.NumSegments].Length = i - start;
+		result.NumSegments++;
+	}
+
+	return result;
+}
+
+// Runtime patterns compile the same way when they are well formed
+static bool TryCompilePattern(const wchar_t* pattern, CompiledPattern* compiled)
+{
+	if (!IsValidPattern(pattern))
+		return false;
+
+	*compiled = CompilePattern(pattern);
+	return true;
+}
+
+#define PRESET_PATTERN(name, literal) \
+	static_assert(IsValidPattern(literal), "Malformed preset pattern " #literal); \
+	static constexpr CompiledPattern name = CompilePattern(literal)
+
+// Taking the leftmost occurrence of each segment is always safe, it leaves
+// the most room for the segments after it
+static bool MatchPattern(const CompiledPattern* pattern, const wchar_t* candidate, int length)
+{
+	const PatternSegment* segments = pattern->Segments;
+	int first = 0;
+	int last = pattern->NumSegments;
+	int at = 0;
+	int end = length;
+
+	if (pattern->AnchoredStart)
+	{
+		const PatternSegment* segment = &segments[first++];
+		if (segment->Length > end || wmemcmp(candidate, pattern->Text + segment->Offset, segment->Length) != 0)
+			return false;
+
+		at = segment->Length;
+
+		// No stars at all, the whole name must be the literal
+		if (pattern->AnchoredEnd && last == 1)
+			return at == end;
+	}
+
+	if (pattern->AnchoredEnd)
+	{
+		const PatternSegment* segment = &segments[--last];
+		if (at + segment->Length > end || wmemcmp(candidate + end - segment->Length, pattern->Text + segment->Offset, segment->Length) != 0)
+			return false;
+
+		end -= segment->Length;
+	}
+
+	for (int s = first; s < last; s++)
+	{
+		const PatternSegment* segment = &segments[s];
+		int found = FindWide(candidate + at, end - at, pattern->Text + segment->Offset, segment->Length);
+		if (found < 0)
+			return false;
+
+		at += found + segment->Length;
+	}
+
+	return true;
+}
+
+static bool MatchPattern(const CompiledPattern* pattern, StringId name)
+{
+	return MatchPattern(pattern, StringText(name), name == STRING_ID_NONE ? 0 : (int)StringLength(name));
+}
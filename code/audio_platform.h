@@ -0,0 +1,62 @@
+#pragma once
+
+// The backend header defines PlatformDevice, CONFIG_PATH, DETAILS_PATH and,
+// off Windows, the Windows base types and Core Audio enums the shared code is
+// written in.
+// The backend .cpp is included by audio.cpp once Device is declared and
+// implements the operations below.
+
+#ifdef _WIN32
+#include "win32_audio.h"
+#else
+#include "linux_audio.h"
+#endif
+
+#include "audio_strings.h"
+
+struct Device;
+struct DeviceDetails;
+struct LevelStream;
+
+static bool PlatformInitialize(void);
+static void PlatformShutdown(void);
+
+// Fills devices with every endpoint and returns how many there are. Nothing
+// is filled when there are more than maxDevices.
+static UINT PlatformEnumerateDevices(Device* devices, UINT maxDevices);
+static void PlatformReleaseDevice(Device* device);
+
+// Id of the current default endpoint for a role and flow
+static StringId PlatformGetDefaultDevice(ERole role, EDataFlow dataFlow);
+
+// Re-reads Info.State, and volume and mute when the endpoint became active
+static HRESULT PlatformUpdateState(Device* device);
+
+// Re-reads Info volume and mute and records Metric_GetVolume
+static HRESULT PlatformReadVolume(Device* device);
+
+static HRESULT PlatformSetVolumeScalar(Device* device, float volumeScalar);
+static HRESULT PlatformSetVolumeLevel(Device* device, float volumeLevel);
+static HRESULT PlatformSetMute(Device* device, BOOL mute);
+static HRESULT PlatformSetVisibility(Device* device, bool visible);
+static HRESULT PlatformSetDefault(Device* device, ERole role);
+
+// Reads the form factor, bus and Stamp of details in one pass over the
+// property store. Stamp changes whenever the mix format could have.
+static HRESULT PlatformReadDetails(Device* device, DeviceDetails* details);
+
+// Fills the mix format and processing periods of details
+static HRESULT PlatformQueryFormat(Device* device, DeviceDetails* details);
+
+// Starts a backend thread that writes the endpoint's signal to stream->Ring
+// as interleaved float samples: a loopback of render endpoints and the
+// captured signal of recording endpoints. Sets Channels, SampleRate and
+// PostGain.
+static bool PlatformStartLevelStream(Device* device, LevelStream* stream);
+static void PlatformStopLevelStream(LevelStream* stream);
+
+// Calls work(i, context) for every i below count and returns once all have
+// finished. Calls run concurrently when the backend allows endpoint calls
+// from several threads.
+typedef void (*PlatformWork)(int index, void* context);
+static void PlatformRunConcurrently(int count, PlatformWork work, void* context);
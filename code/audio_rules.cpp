@@ -0,0 +1,396 @@
+// Rules that react to endpoint state changes while -watch is running.
+//
+// A rules file has one rule per line:
+//
+//     <when> <pattern> <action> [<target pattern>]
+//
+// <when> is active, disabled, unplugged, notpresent or inactive (any state
+// but active). <action> is default, default-comm, unmute, mute, mute-app or
+// unmute-app. Without a target pattern the action applies to the device that
+// changed; with one it applies to the first device of the same flow that
+// matches the target. mute-app and unmute-app require a target, which matches
+// process names among the sessions of the device that changed.
+//
+//     active    *Astro*Game*   default
+//     active    *Astro*Game*   unmute
+//     unplugged *Astro*Game*   default   *Speakers*Realtek*
+//     active    *Astro*Chat*   mute-app  Discord.exe
+//
+// Rules are compiled against the device table after every refresh: each
+// device gets a bitmask of the rules whose pattern matches its name and each
+// rule gets its target device per flow, so an event only looks at the rules
+// of the device that changed.
+
+enum RuleAction {
+	RuleAction_Default,
+	RuleAction_DefaultCommunication,
+	RuleAction_Unmute,
+	RuleAction_Mute,
+	RuleAction_MuteApp,
+	RuleAction_UnmuteApp,
+};
+
+struct Rule {
+	DWORD When;
+	RuleAction Action;
+	wchar_t Pattern[100];
+	wchar_t Target[100];
+	bool HasTarget;
+
+	// Resolved by CompileRules, -1 when no device matches
+	int TargetDevices[2];
+};
+
+#define MAX_RULES 64
+
+static Rule Rules[MAX_RULES];
+static int NumRules;
+static UINT64* RulesByDevice;
+static UINT RulesByDeviceCapacity;
+
+static volatile LONG StopWatching;
+
+static char* RuleActionToString(RuleAction action)
+{
+	if (action == RuleAction_Default)
+		return "default";
+	if (action == RuleAction_DefaultCommunication)
+		return "default-comm";
+	if (action == RuleAction_Unmute)
+		return "unmute";
+	if (action == RuleAction_Mute)
+		return "mute";
+	if (action == RuleAction_MuteApp)
+		return "mute-app";
+	return "unmute-app";
+}
+
+static bool ParseRuleWhen(const char* word, DWORD* when)
+{
+	if (strcmp(word, "active") == 0)
+		*when = DEVICE_STATE_ACTIVE;
+	else if (strcmp(word, "disabled") == 0)
+		*when = DEVICE_STATE_DISABLED;
+	else if (strcmp(word, "unplugged") == 0)
+		*when = DEVICE_STATE_UNPLUGGED;
+	else if (strcmp(word, "notpresent") == 0)
+		*when = DEVICE_STATE_NOTPRESENT;
+	else if (strcmp(word, "inactive") == 0)
+		*when = DEVICE_STATE_DISABLED | DEVICE_STATE_UNPLUGGED | DEVICE_STATE_NOTPRESENT;
+	else
+		return false;
+
+	return true;
+}
+
+static bool ParseRuleAction(const char* word, RuleAction* action)
+{
+	if (strcmp(word, "default") == 0)
+		*action = RuleAction_Default;
+	else if (strcmp(word, "default-comm") == 0)
+		*action = RuleAction_DefaultCommunication;
+	else if (strcmp(word, "unmute") == 0)
+		*action = RuleAction_Unmute;
+	else if (strcmp(word, "mute") == 0)
+		*action = RuleAction_Mute;
+	else if (strcmp(word, "mute-app") == 0)
+		*action = RuleAction_MuteApp;
+	else if (strcmp(word, "unmute-app") == 0)
+		*action = RuleAction_UnmuteApp;
+	else
+		return false;
+
+	return true;
+}
+
+static bool IsSessionRule(Rule* rule)
+{
+	return rule->Action == RuleAction_MuteApp || rule->Action == RuleAction_UnmuteApp;
+}
+
+static bool LoadRules(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+	{
+		printf("Unable to open rules file %s\n", path);
+		return false;
+	}
+
+	NumRules = 0;
+	char line[256];
+	int lineNumber = 0;
+
+	while (fgets(line, sizeof(line), file))
+	{
+		lineNumber++;
+
+		char when[32], pattern[100], action[32], target[100];
+		int fields = sscanf(line, "%31s %99s %31s %99s", when, pattern, action, target);
+
+		if (fields <= 0 || when[0] == '#')
+			continue;
+
+		if (NumRules == MAX_RULES)
+		{
+			printf("Too many rules. Max is %i\n", MAX_RULES);
+			break;
+		}
+
+		Rule* rule = &Rules[NumRules];
+		*rule = {};
+
+		if (fields < 3 || !ParseRuleWhen(when, &rule->When) || !ParseRuleAction(action, &rule->Action))
+		{
+			printf("Ignoring invalid rule on line %i: %s", lineNumber, line);
+			continue;
+		}
+
+		if (fields < 4 && IsSessionRule(rule))
+		{
+			printf("Ignoring %s rule without a process on line %i: %s", action, lineNumber, line);
+			continue;
+		}
+
+		mbstowcs(rule->Pattern, pattern, 100);
+		if (fields == 4)
+		{
+			mbstowcs(rule->Target, target, 100);
+			rule->HasTarget = true;
+		}
+
+		NumRules++;
+	}
+
+	fclose(file);
+	printf("Loaded %i rules from %s\n", NumRules, path);
+
+	return NumRules > 0;
+}
+
+// The first active device of each flow that matches the target, or the
+// first inactive one when none is active
+static void ResolveRuleTargets(Rule* rule)
+{
+	rule->TargetDevices[eRender] = -1;
+	rule->TargetDevices[eCapture] = -1;
+
+	// Session rules target processes, not devices
+	if (!rule->HasTarget || IsSessionRule(rule))
+		return;
+
+	NamePattern target = MakeNamePattern(rule->Target);
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		DeviceInfo* info = &AllDevices[i].Info;
+		int* chosen = &rule->TargetDevices[info->DataFlow];
+
+		// An inactive match is only replaced by an active one
+		if (*chosen >= 0 && (AllDevices[*chosen].Info.State == DEVICE_STATE_ACTIVE || info->State != DEVICE_STATE_ACTIVE))
+			continue;
+
+		if (MatchName(&target, info->Name))
+			*chosen = i;
+	}
+}
+
+static void CompileRules(void)
+{
+	if (NumDevices > RulesByDeviceCapacity)
+	{
+		ArenaFree(RulesByDevice);
+		RulesByDeviceCapacity = NumDevices * 2;
+		RulesByDevice = (UINT64*)ArenaAlloc(RulesByDeviceCapacity * sizeof(UINT64));
+	}
+
+	NamePattern patterns[MAX_RULES];
+	for (int r = 0; r < NumRules; r++)
+	{
+		patterns[r] = MakeNamePattern(Rules[r].Pattern);
+	}
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		UINT64 mask = 0;
+
+		for (int r = 0; r < NumRules; r++)
+		{
+			if (MatchName(&patterns[r], AllDevices[i].Info.Name))
+				mask |= (UINT64)1 << r;
+		}
+
+		RulesByDevice[i] = mask;
+	}
+
+	for (int r = 0; r < NumRules; r++)
+	{
+		ResolveRuleTargets(&Rules[r]);
+	}
+}
+
+// deviceIndex is -1 for a device that is no longer in the table, which
+// only rules with a target can act on
+static bool ApplyRule(Rule* rule, int deviceIndex, EDataFlow dataFlow)
+{
+	if (rule->HasTarget && !IsSessionRule(rule))
+	{
+		// Targets change state without the table changing shape
+		deviceIndex = rule->TargetDevices[dataFlow];
+		if (deviceIndex >= 0 && AllDevices[deviceIndex].Info.State != DEVICE_STATE_ACTIVE)
+		{
+			ResolveRuleTargets(rule);
+			deviceIndex = rule->TargetDevices[dataFlow];
+		}
+	}
+
+	if (deviceIndex < 0)
+		return false;
+
+	Device* device = &AllDevices[deviceIndex];
+
+	if (device->Info.State != DEVICE_STATE_ACTIVE)
+		return false;
+
+	HRESULT result = E_FAIL;
+
+	switch (rule->Action)
+	{
+		case RuleAction_Default:
+			result = EndpointSetDefault(device, eMultimedia);
+			if (SUCCEEDED(result))
+				SetDefaultDeviceIndex(eMultimedia, dataFlow, deviceIndex);
+			break;
+
+		case RuleAction_DefaultCommunication:
+			result = EndpointSetDefault(device, eCommunications);
+			if (SUCCEEDED(result))
+				SetDefaultDeviceIndex(eCommunications, dataFlow, deviceIndex);
+			break;
+
+		case RuleAction_Unmute:
+		case RuleAction_Mute:
+			result = EndpointSetMute(device, rule->Action == RuleAction_Mute);
+			if (SUCCEEDED(result))
+				device->Info.IsMute = rule->Action == RuleAction_Mute;
+			break;
+
+		case RuleAction_MuteApp:
+		case RuleAction_UnmuteApp:
+		{
+			// The cache is walked again only for an endpoint that gained sessions
+			RefreshEndpointSessions(deviceIndex);
+
+			NamePattern process = MakeNamePattern(rule->Target);
+			if (SetEndpointSessions(deviceIndex, &process, 0, rule->Action == RuleAction_MuteApp, false, true) > 0)
+				result = S_OK;
+			break;
+		}
+	}
+
+	return SUCCEEDED(result);
+}
+
+static void HandleDeviceEvent(DeviceEvent* event)
+{
+	int deviceIndex = FindDeviceIndex(FindString(event->Id));
+
+	// Rules are matched against the table the device was in. A removed
+	// device is gone once the table is rebuilt, and strings are reset.
+	UINT64 mask = deviceIndex >= 0 ? RulesByDevice[deviceIndex] : 0;
+	EDataFlow dataFlow = deviceIndex >= 0 ? AllDevices[deviceIndex].Info.DataFlow : eRender;
+	wchar_t name[128] = L"";
+	if (deviceIndex >= 0)
+		wcsncpy(name, StringText(AllDevices[deviceIndex].Info.Name), 127);
+
+	if (event->Type == DeviceEvent_StateChanged && deviceIndex >= 0)
+	{
+		Device* device = &AllDevices[deviceIndex];
+		EndpointUpdateState(device);
+		device->Info.State = event->State;
+	}
+	else
+	{
+		// The device table changed shape, rebuild it and the compiled rules
+		InitializeAndPopulateAllDevices();
+		CompileRules();
+
+		deviceIndex = FindDeviceIndex(FindString(event->Id));
+		if (deviceIndex >= 0)
+		{
+			Device* device = &AllDevices[deviceIndex];
+			mask = RulesByDevice[deviceIndex];
+			dataFlow = device->Info.DataFlow;
+			wcsncpy(name, StringText(device->Info.Name), 127);
+			event->State = device->Info.State;
+		}
+		else if (event->Type != DeviceEvent_Removed)
+		{
+			return;
+		}
+	}
+
+	for (int r = 0; mask != 0; r++, mask >>= 1)
+	{
+		Rule* rule = &Rules[r];
+		if (!(mask & 1) || !(rule->When & event->State))
+			continue;
+
+		bool applied = ApplyRule(rule, deviceIndex, dataFlow);
+
+		printf("%ls -> %s: %s %s in %.3f ms\n",
+			name,
+			DwordToString(event->State),
+			RuleActionToString(rule->Action),
+			applied ? "applied" : "failed",
+			MillisecondsSince(event->Timestamp));
+	}
+}
+
+static BOOL WINAPI StopWatchingHandler(DWORD controlType)
+{
+	InterlockedExchange(&StopWatching, 1);
+	SetEvent(DeviceEvents.Signal);
+	return TRUE;
+}
+
+static void WatchDevices(const char* rulesPath)
+{
+	if (!LoadRules(rulesPath))
+		return;
+
+	CompileRules();
+
+	for (int r = 0; r < NumRules; r++)
+	{
+		if (IsSessionRule(&Rules[r]))
+			Sessions.Notify = true;
+	}
+
+	DeviceEvents.Signal = CreateEvent(NULL, FALSE, FALSE, NULL);
+	InterlockedExchange(&DeviceEvents.Enabled, 1);
+	SetConsoleCtrlHandler(StopWatchingHandler, TRUE);
+
+	printf("Watching for device changes. Press Ctrl+C to stop.\n");
+
+	LONGLONG lastMetrics = GetTimestamp();
+
+	while (!StopWatching)
+	{
+		WaitForSingleObject(DeviceEvents.Signal, Metrics.Path ? METRICS_INTERVAL_MS : INFINITE);
+
+		DeviceEvent event;
+		while (PopDeviceEvent(&event))
+		{
+			HandleDeviceEvent(&event);
+		}
+
+		WriteMetricsEvery(&lastMetrics);
+	}
+
+	InterlockedExchange(&DeviceEvents.Enabled, 0);
+	SetConsoleCtrlHandler(StopWatchingHandler, FALSE);
+	CloseHandle(DeviceEvents.Signal);
+
+	ReleaseSessions();
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+// Substring search over wide strings, used for the literal segments of
+// patterns. Each step compares the first and last needle character against
+// a whole vector of text positions and only verifies the positions where
+// both match, so names are scanned a vector at a time. AVX2 is used when
+// the processor and OS support it, SSE2 otherwise, and plain C off x64.
+//
+// wchar_t is UTF-16 on Windows and UTF-32 on Linux, so the lane width
+// follows WCHAR_MAX.
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define WIDE_SEARCH_SIMD 1
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if WCHAR_MAX > 0xFFFF
+#define WideSet128 _mm_set1_epi32
+#define WideEqual128 _mm_cmpeq_epi32
+#define WideSet256 _mm256_set1_epi32
+#define WideEqual256 _mm256_cmpeq_epi32
+#else
+#define WideSet128 _mm_set1_epi16
+#define WideEqual128 _mm_cmpeq_epi16
+#define WideSet256 _mm256_set1_epi16
+#define WideEqual256 _mm256_cmpeq_epi16
+#endif
+
+// Byte mask bits covering one wchar_t in a movemask result
+#define WIDE_LANE_BITS ((1u << sizeof(wchar_t)) - 1)
+#endif
+
+static int FindWideScalar(const wchar_t* text, int textLength, const wchar_t* needle, int needleLength)
+{
+	for (int i = 0; i + needleLength <= textLength; i++)
+	{
+		if (text[i] == needle[0] && wmemcmp(text + i, needle, needleLength) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+#ifdef WIDE_SEARCH_SIMD
+
+static int LowestBit(UINT mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Offset of the first verified candidate in a movemask result, or -1
+static int VerifyCandidates(UINT mask, const wchar_t* text, const wchar_t* needle, int needleLength)
+{
+	while (mask)
+	{
+		int bit = LowestBit(mask);
+		int offset = bit / (int)sizeof(wchar_t);
+
+		if (wmemcmp(text + offset, needle, needleLength) == 0)
+			return offset;
+
+		mask &= ~(WIDE_LANE_BITS << bit);
+	}
+
+	return -1;
+}
+
+static int FindWideSSE2(const wchar_t* text, int textLength, const wchar_t* needle, int needleLength)
+{
+	const int lanes = 16 / sizeof(wchar_t);
+	__m128i first = WideSet128(needle[0]);
+	__m128i last = WideSet128(needle[needleLength - 1]);
+
+	int i = 0;
+	for (; i + needleLength - 1 + lanes <= textLength; i += lanes)
+	{
+		__m128i blockFirst = _mm_loadu_si128((const __m128i*)(text + i));
+		__m128i blockLast = _mm_loadu_si128((const __m128i*)(text + i + needleLength - 1));
+		UINT mask = (UINT)_mm_movemask_epi8(_mm_and_si128(WideEqual128(first, blockFirst), WideEqual128(last, blockLast)));
+
+		int found = VerifyCandidates(mask, text + i, needle, needleLength);
+		if (found >= 0)
+			return i + found;
+	}
+
+	int found = FindWideScalar(text + i, textLength - i, needle, needleLength);
+	return found >= 0 ? i + found : -1;
+}
+
+TARGET_AVX2 static int FindWideAVX2(const wchar_t* text, int textLength, const wchar_t* needle, int needleLength)
+{
+	const int lanes = 32 / sizeof(wchar_t);
+	__m256i first = WideSet256(needle[0]);
+	__m256i last = WideSet256(needle[needleLength - 1]);
+
+	int i = 0;
+	for (; i + needleLength - 1 + lanes <= textLength; i += lanes)
+	{
+		__m256i blockFirst = _mm256_loadu_si256((const __m256i*)(text + i));
+		__m256i blockLast = _mm256_loadu_si256((const __m256i*)(text + i + needleLength - 1));
+		UINT mask = (UINT)_mm256_movemask_epi8(_mm256_and_si256(WideEqual256(first, blockFirst), WideEqual256(last, blockLast)));
+
+		int found = VerifyCandidates(mask, text + i, needle, needleLength);
+		if (found >= 0)
+			return i + found;
+	}
+
+	// The SSE2 loop takes the remainder a smaller vector at a time
+	int found = FindWideSSE2(text + i, textLength - i, needle, needleLength);
+	return found >= 0 ? i + found : -1;
+}
+
+static bool HasAVX2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+
+	// AVX and OSXSAVE, and the OS saves the YMM registers
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+enum WideSearchLevel {
+	WideSearch_Unknown,
+	WideSearch_Scalar,
+	WideSearch_SSE2,
+	WideSearch_AVX2,
+};
+
+static WideSearchLevel WideSearch;
+
+// Offset of the first occurrence of needle in text, or -1
+static int FindWide(const wchar_t* text, int textLength, const wchar_t* needle, int needleLength)
+{
+	if (needleLength <= 0)
+		return 0;
+
+#ifdef WIDE_SEARCH_SIMD
+	if (WideSearch == WideSearch_Unknown)
+		WideSearch = HasAVX2() ? WideSearch_AVX2 : WideSearch_SSE2;
+
+	if (WideSearch == WideSearch_AVX2)
+		return FindWideAVX2(text, textLength, needle, needleLength);
+	if (WideSearch == WideSearch_SSE2)
+		return FindWideSSE2(text, textLength, needle, needleLength);
+#endif
+
+	return FindWideScalar(text, textLength, needle, needleLength);
+}
@@ -0,0 +1,399 @@
+// Per-application audio sessions on every active endpoint.
+//
+// Sessions are enumerated once, one thread per endpoint, and the resulting
+// session controls are kept until the device table is refreshed. A one-shot
+// -sessions, -sm, -su or -sv walks the session managers once. -watch sets
+// Notify to keep the cache for its whole run: each endpoint registers for new
+// session notifications, and its mute-app and unmute-app rules only walk an
+// endpoint again after it became active or one of its applications opened a
+// session. Sessions that expire stay cached, and writes to them fail
+// harmlessly.
+
+struct Session {
+	DWORD ProcessId;
+	StringId ProcessName;
+	AudioSessionState State;
+	float VolumeScalar;
+	BOOL IsMute;
+
+	ComHandle<IAudioSessionControl2> Control;
+	ComHandle<ISimpleAudioVolume> Volume;
+};
+
+// One per endpoint so a new session only marks its own endpoint stale
+struct SessionNotificationClient : public IAudioSessionNotification
+{
+	volatile LONG Stale;
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object)
+	{
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(IAudioSessionNotification))
+		{
+			*object = (IAudioSessionNotification*)this;
+			return S_OK;
+		}
+
+		*object = NULL;
+		return E_NOINTERFACE;
+	}
+
+	// Freed by ReleaseSessions after unregistering, so reference counting is a no-op
+	ULONG STDMETHODCALLTYPE AddRef() { return 1; }
+	ULONG STDMETHODCALLTYPE Release() { return 1; }
+
+	HRESULT STDMETHODCALLTYPE OnSessionCreated(IAudioSessionControl* control)
+	{
+		InterlockedExchange(&Stale, 1);
+		return S_OK;
+	}
+};
+
+struct EndpointSessions {
+	Session* Sessions;
+	int NumSessions;
+
+	// Only kept while the notifications are registered
+	ComHandle<IAudioSessionManager2> Manager;
+};
+
+struct SessionCache {
+	EndpointSessions* Endpoints;
+	SessionNotificationClient* Notifications;
+	UINT NumEndpoints;
+	UINT Generation;
+	bool Valid;
+	bool Notify;
+};
+
+static SessionCache Sessions;
+
+static void ReleaseEndpointSessions(int deviceIndex)
+{
+	EndpointSessions* endpoint = &Sessions.Endpoints[deviceIndex];
+
+	for (int s = 0; s < endpoint->NumSessions; s++)
+	{
+		endpoint->Sessions[s].Volume.Reset();
+		endpoint->Sessions[s].Control.Reset();
+	}
+
+	if (endpoint->Manager)
+		endpoint->Manager->UnregisterSessionNotification(&Sessions.Notifications[deviceIndex]);
+	endpoint->Manager.Reset();
+
+	ArenaFree(endpoint->Sessions);
+	endpoint->Sessions = NULL;
+	endpoint->NumSessions = 0;
+}
+
+static void ReleaseSessions(void)
+{
+	for (int i = 0; i < Sessions.NumEndpoints; i++)
+	{
+		ReleaseEndpointSessions(i);
+	}
+
+	delete[] Sessions.Notifications;
+	ArenaFree(Sessions.Endpoints);
+
+	Sessions.Endpoints = NULL;
+	Sessions.Notifications = NULL;
+	Sessions.NumEndpoints = 0;
+	Sessions.Valid = false;
+}
+
+static void EnumerateDeviceSessions(int deviceIndex)
+{
+	Device* device = &AllDevices[deviceIndex];
+	EndpointSessions* endpoint = &Sessions.Endpoints[deviceIndex];
+
+	ComHandle<IAudioSessionEnumerator> enumerator;
+
+	// Replayed devices have no endpoint behind them
+	if (!device->Platform.Device)
+		return;
+	LONGLONG start = GetTimestamp();
+	HRESULT result = device->Platform.Device->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, NULL, endpoint->Manager.Put());
+	RecordMetric(Metric_Activate, start, result);
+
+	if (FAILED(result))
+		return;
+	if (FAILED(endpoint->Manager->GetSessionEnumerator(enumerator.Put())))
+	{
+		endpoint->Manager.Reset();
+		return;
+	}
+
+	// New sessions are only reported once an enumerator has been taken
+	if (Sessions.Notifications)
+	{
+		SessionNotificationClient* notifications = &Sessions.Notifications[deviceIndex];
+		InterlockedExchange(&notifications->Stale, 0);
+
+		if (FAILED(endpoint->Manager->RegisterSessionNotification(notifications)))
+			endpoint->Manager.Reset();
+	}
+	else
+	{
+		endpoint->Manager.Reset();
+	}
+
+	int count = 0;
+	enumerator->GetCount(&count);
+	if (count <= 0)
+		return;
+
+	endpoint->Sessions = (Session*)ArenaAlloc(count * sizeof(Session));
+
+	for (int i = 0; i < count; i++)
+	{
+		Session* session = &endpoint->Sessions[endpoint->NumSessions];
+		ComHandle<IAudioSessionControl> control;
+
+		if (FAILED(enumerator->GetSession(i, control.Put())))
+			continue;
+		if (FAILED(control->QueryInterface(__uuidof(IAudioSessionControl2), session->Control.Put())))
+			continue;
+
+		session->Control->GetState(&session->State);
+		if (session->State == AudioSessionStateExpired)
+		{
+			session->Control.Reset();
+			continue;
+		}
+
+		session->Control->GetProcessId(&session->ProcessId);
+
+		if (SUCCEEDED(control->QueryInterface(__uuidof(ISimpleAudioVolume), session->Volume.Put())))
+		{
+			session->Volume->GetMasterVolume(&session->VolumeScalar);
+			session->Volume->GetMute(&session->IsMute);
+		}
+
+		endpoint->NumSessions++;
+	}
+}
+
+static DWORD WINAPI EnumerateSessionsThread(void* parameter)
+{
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	EnumerateDeviceSessions((int)(SIZE_T)parameter);
+	CoUninitialize();
+
+	return 0;
+}
+
+static void NameAllSessions(void)
+{
+	// One process snapshot names every session, rather than one
+	// OpenProcess call per session
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+
+	PROCESSENTRY32W process;
+	process.dwSize = sizeof(process);
+
+	BOOL more = snapshot != INVALID_HANDLE_VALUE && Process32FirstW(snapshot, &process);
+	for (; more; more = Process32NextW(snapshot, &process))
+	{
+		StringId name = STRING_ID_NONE;
+
+		for (int i = 0; i < Sessions.NumEndpoints; i++)
+		{
+			EndpointSessions* endpoint = &Sessions.Endpoints[i];
+
+			for (int s = 0; s < endpoint->NumSessions; s++)
+			{
+				Session* session = &endpoint->Sessions[s];
+				if (session->ProcessId != process.th32ProcessID || session->ProcessId == 0)
+					continue;
+
+				if (name == STRING_ID_NONE)
+					name = InternString(process.szExeFile);
+				session->ProcessName = name;
+			}
+		}
+	}
+
+	if (snapshot != INVALID_HANDLE_VALUE)
+		CloseHandle(snapshot);
+
+	StringId systemSounds = InternString(L"System Sounds");
+	for (int i = 0; i < Sessions.NumEndpoints; i++)
+	{
+		EndpointSessions* endpoint = &Sessions.Endpoints[i];
+
+		for (int s = 0; s < endpoint->NumSessions; s++)
+		{
+			if (endpoint->Sessions[s].ProcessId == 0)
+				endpoint->Sessions[s].ProcessName = systemSounds;
+		}
+	}
+}
+
+static void EnumerateAllSessions(void)
+{
+	if (Sessions.Valid && Sessions.Generation == DeviceGeneration)
+		return;
+
+	ReleaseSessions();
+
+	Sessions.Generation = DeviceGeneration;
+	Sessions.Valid = true;
+
+	if (NumDevices == 0)
+		return;
+
+	Sessions.NumEndpoints = NumDevices;
+	Sessions.Endpoints = (EndpointSessions*)ArenaAlloc(NumDevices * sizeof(EndpointSessions));
+	if (Sessions.Notify)
+		Sessions.Notifications = new SessionNotificationClient[NumDevices]();
+
+	HANDLE* threads = (HANDLE*)ArenaAlloc(NumDevices * sizeof(HANDLE));
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		if (AllDevices[i].Info.State != DEVICE_STATE_ACTIVE)
+			continue;
+
+		threads[i] = CreateThread(NULL, 0, EnumerateSessionsThread, (void*)(SIZE_T)i, 0, NULL);
+
+		// Fall back to enumerating on this thread
+		if (threads[i] == NULL)
+			EnumerateDeviceSessions(i);
+	}
+
+	for (int i = 0; i < NumDevices; i++)
+	{
+		if (threads[i] == NULL)
+			continue;
+
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+
+	ArenaFree(threads);
+
+	NameAllSessions();
+}
+
+// Walks one endpoint again when it had no session manager, because it was
+// inactive when the cache was built, or when one of its applications opened
+// a session since
+static void RefreshEndpointSessions(int deviceIndex)
+{
+	EnumerateAllSessions();
+
+	if (deviceIndex >= Sessions.NumEndpoints)
+		return;
+	if (Sessions.Notifications && Sessions.Endpoints[deviceIndex].Manager && !Sessions.Notifications[deviceIndex].Stale)
+		return;
+
+	ReleaseEndpointSessions(deviceIndex);
+	EnumerateDeviceSessions(deviceIndex);
+	NameAllSessions();
+}
+
+static void PrintAllSessions()
+{
+	EnumerateAllSessions();
+
+	int widthShort = 7;
+	int widthLong = 30;
+	int precisionInt = 0;
+
+	for (int i = 0; i < Sessions.NumEndpoints; i++)
+	{
+		EndpointSessions* endpoint = &Sessions.Endpoints[i];
+		if (endpoint->NumSessions == 0)
+			continue;
+
+		printf("------------ %ls ------------\n", StringText(AllDevices[i].Info.Name));
+
+		for (int s = 0; s < endpoint->NumSessions; s++)
+		{
+			Session* session = &endpoint->Sessions[s];
+
+			printf("Process: %*ls", widthLong, StringText(session->ProcessName));
+			printf("   PID: %*lu", widthShort, session->ProcessId);
+			printf("   Scalar: %3.*f", precisionInt, session->VolumeScalar * 100);
+			printf("   %*s", widthShort, BoolToString(session->IsMute));
+			printf("   %s\n", session->State == AudioSessionStateActive ? "Active" : "Inactive");
+		}
+
+		printf("\n");
+	}
+}
+
+// Sets volume and/or mute on the sessions of one endpoint whose process
+// matches and returns how many were written
+static int SetEndpointSessions(int deviceIndex, const NamePattern* process, float volumeScalar, BOOL mute, bool setVolume, bool setMute)
+{
+	EndpointSessions* endpoint = &Sessions.Endpoints[deviceIndex];
+	int changed = 0;
+
+	for (int s = 0; s < endpoint->NumSessions; s++)
+	{
+		Session* session = &endpoint->Sessions[s];
+
+		if (!session->Volume || !MatchName(process, session->ProcessName))
+			continue;
+
+		if (setVolume)
+		{
+			LONGLONG start = GetTimestamp();
+			HRESULT result = session->Volume->SetMasterVolume(volumeScalar, &GUID_NULL);
+			RecordMetric(Metric_SetSessionVolume, start, result);
+
+			if (SUCCEEDED(result))
+				session->VolumeScalar = volumeScalar;
+		}
+
+		if (setMute)
+		{
+			LONGLONG start = GetTimestamp();
+			HRESULT result = session->Volume->SetMute(mute, &GUID_NULL);
+			RecordMetric(Metric_SetSessionMute, start, result);
+
+			if (SUCCEEDED(result))
+				session->IsMute = mute;
+		}
+
+		printf("%ls on %ls: %3.0f %s\n",
+			StringText(session->ProcessName),
+			StringText(AllDevices[deviceIndex].Info.Name),
+			session->VolumeScalar * 100,
+			BoolToString(session->IsMute));
+
+		changed++;
+	}
+
+	return changed;
+}
+
+// Sets volume and/or mute on every session whose process matches, optionally
+// limited to endpoints whose name matches devicePattern.
+static int SetSessionsWhere(const wchar_t* processPattern, const wchar_t* devicePattern, float volumeScalar, BOOL mute, bool setVolume, bool setMute)
+{
+	EnumerateAllSessions();
+
+	NamePattern process = MakeNamePattern(processPattern);
+	NamePattern device = devicePattern ? MakeNamePattern(devicePattern) : NamePattern{};
+
+	int changed = 0;
+
+	for (int i = 0; i < Sessions.NumEndpoints; i++)
+	{
+		if (Sessions.Endpoints[i].NumSessions == 0)
+			continue;
+
+		if (devicePattern && !MatchName(&device, AllDevices[i].Info.Name))
+			continue;
+
+		changed += SetEndpointSessions(i, &process, volumeScalar, mute, setVolume, setMute);
+	}
+
+	if (changed == 0)
+		printf("No sessions matching %ls\n", processPattern);
+
+	return changed;
+}
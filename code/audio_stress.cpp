@@ -0,0 +1,290 @@
+// Scale harness, run with -stress [max devices].
+//
+// Generates synthetic device sets of growing size (see audio_trace.cpp) and
+// times list, mute by pattern, a star-heavy pattern, save, load and a preset
+// at each size. Every step grows the device count tenfold, so a linear path
+// takes about ten times longer. A path whose time grows faster than
+// STRESS_MAX_EXPONENT (time ~ devices^exponent), fitted across every size
+// that took long enough to measure, fails the run. Each size runs every
+// operation STRESS_REPEATS times from cold caches and keeps the fastest, so
+// one slow run or the step where devices stop fitting in cache does not
+// read as growth. Patterns match the same share of devices at every size.
+// The command buffer skips writes of values a device already has, so every
+// repeat writes different values, and load and preset, which write fixed
+// ones, start from devices moved away from them.
+//
+// Before timing anything it checks that every search kernel FindWide can
+// dispatch to on this machine finds the same offsets, since the patterns of
+// every operation go through them.
+
+enum StressOp {
+	StressOp_Enumerate,
+	StressOp_List,
+	StressOp_Mute,
+	StressOp_StarPattern,
+	StressOp_Save,
+	StressOp_Load,
+	StressOp_Preset,
+	StressOp_Count
+};
+
+static const char* StressOpNames[StressOp_Count] = {
+	"enumerate",
+	"list",
+	"mute",
+	"star pattern",
+	"save",
+	"load",
+	"preset",
+};
+
+#define MAX_STRESS_SIZES 8
+#define STRESS_MAX_EXPONENT 1.2
+#define STRESS_REPEATS 5
+
+// Larger than the last level cache, written before every timed run so
+// small sizes start as cold as large ones that never fit
+#define STRESS_EVICT_BYTES (64 * 1024 * 1024)
+
+// Sizes faster than this are mostly timer noise
+#define STRESS_MIN_MILLISECONDS 0.01
+
+#define STRESS_CONFIG_PATH "stress_config.txt"
+
+#ifdef _WIN32
+#define NULL_DEVICE_PATH "NUL"
+#else
+#define NULL_DEVICE_PATH "/dev/null"
+#endif
+
+#define SEARCH_TEST_LENGTH 80
+#define SEARCH_TEST_NEEDLE 6
+
+typedef int (*FindWideKernel)(const wchar_t* text, int textLength, const wchar_t* needle, int needleLength);
+
+// Every text length through the vector loops and their tails, with the
+// needle at every offset, so matches start and end on both sides of every
+// vector boundary, and with no match. Longer needles are surrounded by
+// decoys that share their first and last character. The text ends at the
+// end of the buffer so a read past it is a read past the array.
+static bool TestSearchKernels(void)
+{
+	FindWideKernel kernels[3];
+	const char* names[3];
+	int numKernels = 0;
+
+	kernels[numKernels] = FindWideScalar;
+	names[numKernels++] = "scalar";
+#ifdef WIDE_SEARCH_SIMD
+	kernels[numKernels] = FindWideSSE2;
+	names[numKernels++] = "SSE2";
+	if (HasAVX2())
+	{
+		kernels[numKernels] = FindWideAVX2;
+		names[numKernels++] = "AVX2";
+	}
+#endif
+
+	wchar_t buffer[SEARCH_TEST_LENGTH];
+	wchar_t needle[SEARCH_TEST_NEEDLE];
+
+	for (int needleLength = 1; needleLength <= SEARCH_TEST_NEEDLE; needleLength++)
+	{
+		wmemset(needle, L'c', needleLength);
+		needle[needleLength - 1] = L'd';
+		needle[0] = L'b';
+
+		for (int textLength = 0; textLength <= SEARCH_TEST_LENGTH; textLength++)
+		{
+			wchar_t* text = buffer + SEARCH_TEST_LENGTH - textLength;
+
+			// -1 is the text without the needle
+			for (int at = -1; at + needleLength <= textLength; at++)
+			{
+				wmemset(text, L'a', textLength);
+				for (int d = 0; needleLength > 2 && d + needleLength <= textLength; d += needleLength + 1)
+				{
+					wmemset(text + d, L'x', needleLength);
+					text[d] = L'b';
+					text[d + needleLength - 1] = L'd';
+				}
+
+				if (at >= 0)
+					wmemcpy(text + at, needle, needleLength);
+
+				for (int k = 0; k < numKernels; k++)
+				{
+					int found = kernels[k](text, textLength, needle, needleLength);
+					if (found != at)
+					{
+						printf("%s search found %d instead of %d in %d characters for a %d character needle\n",
+							names[k], found, at, textLength, needleLength);
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+static void RunStressOp(StressOp op, int repeat, FILE* output)
+{
+	float volumeScalar = (float)(repeat + 1) / (STRESS_REPEATS + 1);
+	BOOL mute = repeat % 2 == 0;
+
+	switch (op)
+	{
+	case StressOp_Enumerate: InitializeAndPopulateAllDevices(); break;
+	case StressOp_List: PrintAllDevices(output); break;
+	case StressOp_Mute: SetDevicesWhere(volumeScalar, mute, L"*Synthetic*0)", false); break;
+	case StressOp_StarPattern: SetDevicesWhere(1.0f - volumeScalar, !mute, L"*a*a*a*a*a*a*a*a*a*a*a*a*b*", false); break;
+	case StressOp_Save: SaveAllInfo(STRESS_CONFIG_PATH, output); break;
+	case StressOp_Load: LoadAllInfo(STRESS_CONFIG_PATH, output); break;
+	case StressOp_Preset: SetAstroDevices(output); break;
+	default: break;
+	}
+
+	FlushCommands();
+}
+
+// Untimed. Moves every active device to a volume no operation writes and to
+// muted, and the defaults to a device the preset does not choose, so load
+// and preset write every field they touch. Load then only skips mute on the
+// devices the mute operation muted.
+static void UnsettleDevices(void)
+{
+	for (int i = 0; i < NumDevices; i++)
+	{
+		Device* device = &AllDevices[i];
+		if (device->Info.State != DEVICE_STATE_ACTIVE)
+			continue;
+
+		QueueVolumeScalar(device, 0.37f);
+		QueueMute(device, TRUE);
+	}
+
+	for (int role = 0; role < ERole_enum_count; role++)
+	{
+		SetDefaultDevicesWhere((ERole)role, eRender, L"Speakers (Synthetic*");
+		SetDefaultDevicesWhere((ERole)role, eCapture, L"Microphone (Synthetic*");
+	}
+
+	FlushCommands();
+}
+
+static void EvictCaches(BYTE* evict)
+{
+	for (UINT i = 0; i < STRESS_EVICT_BYTES; i += 64)
+	{
+		evict[i]++;
+	}
+}
+
+static bool RunStressTest(UINT maxDevices)
+{
+	FILE* output = fopen(NULL_DEVICE_PATH, "w");
+	if (output == NULL)
+	{
+		printf("Unable to open %s\n", NULL_DEVICE_PATH);
+		return false;
+	}
+
+	bool kernels = TestSearchKernels();
+	printf("search kernels %s\n", kernels ? "passed" : "FAILED");
+
+	BYTE* evict = (BYTE*)ArenaAlloc(STRESS_EVICT_BYTES);
+
+	UINT sizes[MAX_STRESS_SIZES];
+	double milliseconds[MAX_STRESS_SIZES][StressOp_Count];
+	int numSizes = 0;
+
+	for (UINT size = 10; size <= maxDevices && numSizes < MAX_STRESS_SIZES; size *= 10)
+	{
+		StartSyntheticDevices(size);
+		sizes[numSizes] = size;
+
+		printf("\n%u devices\n", size);
+
+		for (int repeat = 0; repeat < STRESS_REPEATS; repeat++)
+		{
+			for (int op = 0; op < StressOp_Count; op++)
+			{
+				if (op == StressOp_Load || op == StressOp_Preset)
+					UnsettleDevices();
+
+				EvictCaches(evict);
+
+				LONGLONG start = GetTimestamp();
+				RunStressOp((StressOp)op, repeat, output);
+
+				double elapsed = MillisecondsSince(start);
+				if (repeat == 0 || elapsed < milliseconds[numSizes][op])
+					milliseconds[numSizes][op] = elapsed;
+			}
+		}
+
+		numSizes++;
+	}
+
+	fclose(output);
+	ArenaFree(evict);
+	remove(STRESS_CONFIG_PATH);
+	ReleaseAllDevices();
+
+	printf("\n%-14s", "ns per device");
+	for (int s = 0; s < numSizes; s++)
+	{
+		printf("%10u", sizes[s]);
+	}
+	printf("%10s\n", "exponent");
+
+	bool passed = kernels;
+
+	for (int op = 0; op < StressOp_Count; op++)
+	{
+		printf("%-14s", StressOpNames[op]);
+
+		for (int s = 0; s < numSizes; s++)
+		{
+			printf("%10.0f", milliseconds[s][op] * 1000000.0 / sizes[s]);
+		}
+
+		// Least-squares slope of log time over log size, across the sizes
+		// that took long enough to measure. A step where the devices stop
+		// fitting in cache moves it far less than growth at every step.
+		double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+		int measured = 0;
+		for (int s = 0; s < numSizes; s++)
+		{
+			if (milliseconds[s][op] < STRESS_MIN_MILLISECONDS)
+				continue;
+
+			double x = log((double)sizes[s]);
+			double y = log(milliseconds[s][op]);
+			sumX += x;
+			sumY += y;
+			sumXX += x * x;
+			sumXY += x * y;
+			measured++;
+		}
+
+		// Too fast to measure at two sizes is linear enough
+		double exponent = 0.0;
+		if (measured >= 2)
+			exponent = (measured * sumXY - sumX * sumY) / (measured * sumXX - sumX * sumX);
+
+		bool linear = exponent <= STRESS_MAX_EXPONENT;
+		printf("%10.2f%s\n", exponent, linear ? "" : "  super-linear");
+
+		if (!linear)
+			passed = false;
+	}
+
+	if (!kernels)
+		printf("\nStress test FAILED, the search kernels disagree.\n");
+	else
+		printf("\n%s\n", passed ? "Stress test passed." : "Stress test FAILED, a path grows faster than linear.");
+	return passed;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+// Interned strings for endpoint Ids and friendly names.
+// Every distinct string is copied once into a single contiguous buffer and
+// identified by a StringId, so equal strings always have equal ids and
+// identity checks are integer compares. The arena is cleared on each refresh.
+
+typedef UINT StringId;
+#define STRING_ID_NONE 0
+
+struct InternedString {
+	UINT Offset;
+	UINT Length;
+	UINT Hash;
+};
+
+struct StringArena {
+	wchar_t* Text;
+	UINT TextUsed;
+	UINT TextCapacity;
+
+	// Entries[0] is reserved so that STRING_ID_NONE never names a string
+	InternedString* Entries;
+	UINT NumEntries;
+	UINT EntryCapacity;
+
+	// Open addressing table of StringIds, size is a power of two
+	StringId* Slots;
+	UINT NumSlots;
+};
+
+static StringArena Strings;
+
+static void* ArenaAlloc(SIZE_T size)
+{
+	return VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+static void ArenaFree(void* memory)
+{
+	if (memory)
+		VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+static UINT HashString(const wchar_t* string, UINT length)
+{
+	// FNV-1a over UTF-16 code units
+	UINT hash = 2166136261u;
+	for (UINT i = 0; i < length; i++)
+	{
+		hash ^= (UINT)string[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// FNV-1a over bytes, continuing from hash
+static UINT HashBytes(UINT hash, const void* data, SIZE_T size)
+{
+	const BYTE* bytes = (const BYTE*)data;
+	for (SIZE_T i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static const wchar_t* StringText(StringId id)
+{
+	if (id == STRING_ID_NONE)
+		return L"";
+	return Strings.Text + Strings.Entries[id].Offset;
+}
+
+static UINT StringLength(StringId id)
+{
+	return Strings.Entries[id].Length;
+}
+
+static void ResetStrings(void)
+{
+	Strings.TextUsed = 0;
+	Strings.NumEntries = 1;
+
+	if (Strings.Slots)
+		memset(Strings.Slots, 0, Strings.NumSlots * sizeof(StringId));
+}
+
+static void RebuildStringSlots(UINT numSlots)
+{
+	ArenaFree(Strings.Slots);
+	Strings.Slots = (StringId*)ArenaAlloc(numSlots * sizeof(StringId));
+	Strings.NumSlots = numSlots;
+
+	UINT mask = numSlots - 1;
+	for (StringId id = 1; id < Strings.NumEntries; id++)
+	{
+		UINT slot = Strings.Entries[id].Hash & mask;
+		while (Strings.Slots[slot] != STRING_ID_NONE)
+			slot = (slot + 1) & mask;
+
+		Strings.Slots[slot] = id;
+	}
+}
+
+static void ReserveStrings(UINT numEntries, UINT numChars)
+{
+	if (Strings.NumEntries == 0)
+		Strings.NumEntries = 1;
+
+	if (Strings.NumEntries + numEntries > Strings.EntryCapacity)
+	{
+		UINT capacity = Strings.EntryCapacity ? Strings.EntryCapacity : 256;
+		while (capacity < Strings.NumEntries + numEntries)
+			capacity *= 2;
+
+		InternedString* entries = (InternedString*)ArenaAlloc(capacity * sizeof(InternedString));
+		if (Strings.Entries)
+			memcpy(entries, Strings.Entries, Strings.NumEntries * sizeof(InternedString));
+
+		ArenaFree(Strings.Entries);
+		Strings.Entries = entries;
+		Strings.EntryCapacity = capacity;
+	}
+
+	if (Strings.TextUsed + numChars > Strings.TextCapacity)
+	{
+		UINT capacity = Strings.TextCapacity ? Strings.TextCapacity : 16384;
+		while (capacity < Strings.TextUsed + numChars)
+			capacity *= 2;
+
+		wchar_t* text = (wchar_t*)ArenaAlloc(capacity * sizeof(wchar_t));
+		if (Strings.Text)
+			memcpy(text, Strings.Text, Strings.TextUsed * sizeof(wchar_t));
+
+		ArenaFree(Strings.Text);
+		Strings.Text = text;
+		Strings.TextCapacity = capacity;
+	}
+
+	// Keep the table at most half full
+	if ((Strings.NumEntries + numEntries) * 2 > Strings.NumSlots)
+	{
+		UINT numSlots = Strings.NumSlots ? Strings.NumSlots : 512;
+		while ((Strings.NumEntries + numEntries) * 2 > numSlots)
+			numSlots *= 2;
+
+		RebuildStringSlots(numSlots);
+	}
+}
+
+static StringId FindString(const wchar_t* string, UINT length, UINT hash)
+{
+	if (Strings.NumSlots == 0)
+		return STRING_ID_NONE;
+
+	UINT mask = Strings.NumSlots - 1;
+	for (UINT slot = hash & mask; Strings.Slots[slot] != STRING_ID_NONE; slot = (slot + 1) & mask)
+	{
+		StringId id = Strings.Slots[slot];
+		InternedString* entry = &Strings.Entries[id];
+
+		if (entry->Hash == hash && entry->Length == length &&
+			memcmp(Strings.Text + entry->Offset, string, length * sizeof(wchar_t)) == 0)
+			return id;
+	}
+
+	return STRING_ID_NONE;
+}
+
+// Returns the id of an already interned string, or STRING_ID_NONE
+static StringId FindString(const wchar_t* string)
+{
+	if (string == NULL)
+		return STRING_ID_NONE;
+
+	UINT length = (UINT)wcslen(string);
+	return FindString(string, length, HashString(string, length));
+}
+
+static StringId InternString(const wchar_t* string)
+{
+	if (string == NULL)
+		return STRING_ID_NONE;
+
+	UINT length = (UINT)wcslen(string);
+	UINT hash = HashString(string, length);
+
+	StringId id = FindString(string, length, hash);
+	if (id != STRING_ID_NONE)
+		return id;
+
+	ReserveStrings(1, length + 1);
+
+	id = Strings.NumEntries++;
+	InternedString* entry = &Strings.Entries[id];
+	entry->Offset = Strings.TextUsed;
+	entry->Length = length;
+	entry->Hash = hash;
+
+	memcpy(Strings.Text + Strings.TextUsed, string, (length + 1) * sizeof(wchar_t));
+	Strings.TextUsed += length + 1;
+
+	UINT mask = Strings.NumSlots - 1;
+	UINT slot = hash & mask;
+	while (Strings.Slots[slot] != STRING_ID_NONE)
+		slot = (slot + 1) & mask;
+
+	Strings.Slots[slot] = id;
+
+	return id;
+}
@@ -0,0 +1,221 @@
+// Glitch-free profile switching, run with -switch before a command.
+//
+// FlushCommands issues writes in a fixed order, so a target can be unmuted
+// at its old volume before it becomes the default, and streams can land on
+// it while its volume is still changing. SwitchCommands drains the same
+// buffer in an order that keeps every change silent:
+//
+//     1. stage: show and re-read hidden targets, mute targets that will end
+//        up unmuted, then write volumes and mutes, holding back unmutes
+//     2. flip defaults, once every target is staged
+//     3. unmute the staged targets, once every default points at them
+//     4. hide devices whose last visibility write was hidden
+//
+// Steps inside a phase touch different devices or roles and do not depend
+// on each other, so each phase runs them concurrently. The time of each
+// phase and of the whole switch is printed when it finishes.
+
+#define COMMAND_DEFAULT 0x10
+
+struct SwitchDefault {
+	ERole Role;
+	EDataFlow DataFlow;
+	int Index;
+	HRESULT Result;
+};
+
+struct SwitchPlan {
+	// AllDevices indices, copied from the dirty list
+	int* Devices;
+	int NumDevices;
+
+	// Staged devices to unmute once the defaults point at them
+	int* Unmute;
+	volatile LONG NumUnmute;
+
+	SwitchDefault Defaults[ERole_enum_count * 2];
+	int NumDefaults;
+};
+
+static bool SwitchMode;
+
+static void RunSwitchPhase(int count, PlatformWork work, SwitchPlan* plan)
+{
+	if (count == 0)
+		return;
+
+	// Traces are one ordered stream of calls, so they stay on this thread
+	if (Trace.Mode != TraceMode_Off)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			work(i, plan);
+		}
+		return;
+	}
+
+	PlatformRunConcurrently(count, work, plan);
+}
+
+static void StageDevice(int index, void* context)
+{
+	SwitchPlan* plan = (SwitchPlan*)context;
+	Device* device = &AllDevices[plan->Devices[index]];
+	DeviceCommands* commands = &Commands.Devices[plan->Devices[index]];
+	DeviceInfo* info = &device->Info;
+
+	bool writesVolume = (commands->Fields & (COMMAND_VOLUME | COMMAND_MUTE)) != 0;
+	bool show = (commands->Fields & COMMAND_SHOW) && (commands->Visible || writesVolume);
+
+	if (show && info->State != DEVICE_STATE_ACTIVE)
+	{
+		EndpointSetVisibility(device, true);
+		EndpointUpdateState(device);
+	}
+
+	if (info->State != DEVICE_STATE_ACTIVE)
+		return;
+
+	// Shown endpoints had their volume and mute re-read by the state update.
+	// A mute that still was not read is only known when this command writes it.
+	bool muteKnown = info->HasVolume || (commands->Fields & COMMAND_MUTE);
+	BOOL finalMute = (commands->Fields & COMMAND_MUTE) ? commands->Mute : info->IsMute;
+	float volume = commands->VolumeIsLevel ? info->VolumeLevel : info->VolumeScalar;
+	bool changesVolume = (commands->Fields & COMMAND_VOLUME) && (!info->HasVolume || commands->Volume != volume);
+	bool target = changesVolume || (commands->Fields & COMMAND_DEFAULT);
+
+	// Volume changes and new streams happen while the target is silent
+	if (target && muteKnown && !finalMute && !(info->HasVolume && info->IsMute))
+	{
+		if (SUCCEEDED(EndpointSetMute(device, TRUE)))
+			info->IsMute = TRUE;
+	}
+
+	// Unmutes wait for the unmute phase, only mutes are written now
+	DeviceCommands staged = *commands;
+	if (!finalMute)
+		staged.Fields &= ~COMMAND_MUTE;
+
+	FlushVolume(device, &staged);
+
+	if (muteKnown && !finalMute && (info->IsMute || !info->HasVolume))
+	{
+		LONG slot = InterlockedIncrement(&plan->NumUnmute) - 1;
+		plan->Unmute[slot] = plan->Devices[index];
+	}
+}
+
+static void FlipDefault(int index, void* context)
+{
+	SwitchPlan* plan = (SwitchPlan*)context;
+	SwitchDefault* flip = &plan->Defaults[index];
+	flip->Result = EndpointSetDefault(&AllDevices[flip->Index], flip->Role);
+}
+
+static void UnmuteDevice(int index, void* context)
+{
+	SwitchPlan* plan = (SwitchPlan*)context;
+	Device* device = &AllDevices[plan->Unmute[index]];
+
+	if (SUCCEEDED(EndpointSetMute(device, FALSE)))
+		device->Info.IsMute = FALSE;
+}
+
+static void HideDevice(int index, void* context)
+{
+	SwitchPlan* plan = (SwitchPlan*)context;
+	Device* device = &AllDevices[plan->Devices[index]];
+	DeviceCommands* commands = &Commands.Devices[plan->Devices[index]];
+
+	if ((commands->Fields & COMMAND_VISIBILITY) && !commands->Visible)
+		EndpointSetVisibility(device, false);
+}
+
+static void SwitchCommands(void)
+{
+	LONGLONG start = GetTimestamp();
+	SwitchPlan plan = {};
+
+	// New default targets are staged like any other written device
+	for (int role = 0; role < ERole_enum_count; role++)
+	{
+		for (int dataFlow = 0; dataFlow < 2; dataFlow++)
+		{
+			int index = Commands.Defaults[role][dataFlow] - 1;
+			if (index < 0)
+				continue;
+
+			// Current defaults are read now, stage threads never touch the table
+			if (GetDefaultDeviceIndex((ERole)role, (EDataFlow)dataFlow) == index)
+				Commands.Defaults[role][dataFlow] = 0;
+			else
+				GetDeviceCommands(&AllDevices[index])->Fields |= COMMAND_DEFAULT;
+		}
+	}
+
+	if (Commands.NumDirty == 0)
+		return;
+
+	plan.NumDevices = (int)Commands.NumDirty;
+	plan.Devices = (int*)ArenaAlloc(plan.NumDevices * sizeof(int));
+	plan.Unmute = (int*)ArenaAlloc(plan.NumDevices * sizeof(int));
+	memcpy(plan.Devices, Commands.Dirty, plan.NumDevices * sizeof(int));
+
+	LONGLONG phase = GetTimestamp();
+	RunSwitchPhase(plan.NumDevices, StageDevice, &plan);
+	double stageMilliseconds = MillisecondsSince(phase);
+
+	for (int role = 0; role < ERole_enum_count; role++)
+	{
+		for (int dataFlow = 0; dataFlow < 2; dataFlow++)
+		{
+			int index = Commands.Defaults[role][dataFlow] - 1;
+			Commands.Defaults[role][dataFlow] = 0;
+
+			if (index < 0 || AllDevices[index].Info.State != DEVICE_STATE_ACTIVE)
+				continue;
+
+			SwitchDefault* flip = &plan.Defaults[plan.NumDefaults++];
+			flip->Role = (ERole)role;
+			flip->DataFlow = (EDataFlow)dataFlow;
+			flip->Index = index;
+		}
+	}
+
+	phase = GetTimestamp();
+	RunSwitchPhase(plan.NumDefaults, FlipDefault, &plan);
+	double defaultMilliseconds = MillisecondsSince(phase);
+
+	// S_FALSE is a role the backend has no default for
+	int switchedDefaults = 0;
+	for (int i = 0; i < plan.NumDefaults; i++)
+	{
+		SwitchDefault* flip = &plan.Defaults[i];
+		if (flip->Result == S_OK)
+		{
+			SetDefaultDeviceIndex(flip->Role, flip->DataFlow, flip->Index);
+			switchedDefaults++;
+		}
+	}
+
+	phase = GetTimestamp();
+	RunSwitchPhase(plan.NumUnmute, UnmuteDevice, &plan);
+	double unmuteMilliseconds = MillisecondsSince(phase);
+
+	phase = GetTimestamp();
+	RunSwitchPhase(plan.NumDevices, HideDevice, &plan);
+	double hideMilliseconds = MillisecondsSince(phase);
+
+	for (int d = 0; d < plan.NumDevices; d++)
+	{
+		Commands.Devices[plan.Devices[d]] = {};
+	}
+	Commands.NumDirty = 0;
+
+	ArenaFree(plan.Unmute);
+	ArenaFree(plan.Devices);
+
+	printf("Switched %d devices and %d defaults in %.1f ms (stage %.1f, defaults %.1f, unmute %.1f, hide %.1f)\n",
+		plan.NumDevices, switchedDefaults, MillisecondsSince(start),
+		stageMilliseconds, defaultMilliseconds, unmuteMilliseconds, hideMilliseconds);
+}
@@ -0,0 +1,806 @@
+// Record and replay of endpoint calls.
+//
+// The shared code reaches the backend only through the Endpoint* functions
+// below. -record <trace> <command> runs a command normally and writes every
+// enumeration and endpoint call, with its arguments, HRESULT and latency, to
+// a trace. -replay <trace> <command> runs a command against a trace instead
+// of the audio system: devices come from the recorded enumeration, and each
+// call waits for the recorded latency and returns the recorded HRESULT. No
+// audio devices are needed, so a trace from any machine replays on Linux.
+//
+// Replayed calls are matched to recorded ones by operation and device rather
+// than by position, so a change that reorders or drops calls still replays
+// against the same device shape. The recorded calls for each operation and
+// device are chained in order behind one hash slot, so matching a call costs
+// the same however long the trace is. Calls with no recorded counterpart take
+// the mean latency of their operation and succeed.
+//
+// The trace is a byte stream of records. Integers are LEB128 varints, floats
+// are 4 little-endian bytes and strings are a varint length followed by one
+// varint per wchar_t.
+//
+//     header       'C' 'A' 'D' 'T' version
+//     enumerate    op count {id name flow state scalar level mute}*count latency
+//     get default  op role*2+flow deviceIndex+1 latency
+//     device call  op deviceIndex argument result latency
+//
+// Enumerations that did not fit the caller are not recorded, the caller
+// enumerates again with room. Version 1 traces wrote a device count after
+// count, 0 for those enumerations, and still replay.
+//
+// Extended details are not part of a trace and are unavailable in replay.
+//
+// Synthetic mode stands in for the audio system with generated devices, for
+// the stress harness. Calls succeed immediately and update Info, and nothing
+// is recorded.
+
+enum TraceMode {
+	TraceMode_Off,
+	TraceMode_Record,
+	TraceMode_Replay,
+	TraceMode_Synthetic,
+};
+
+enum TraceOp {
+	TraceOp_Enumerate,
+	TraceOp_GetDefault,
+	TraceOp_UpdateState,
+	TraceOp_SetVolumeScalar,
+	TraceOp_SetVolumeLevel,
+	TraceOp_SetMute,
+	TraceOp_SetVisibility,
+	TraceOp_SetDefault,
+	TraceOp_Count
+};
+
+#define TRACE_VERSION 2
+
+// The metric each replayed call is counted under
+static const MetricOp TraceOpMetrics[TraceOp_Count] = {
+	Metric_Enumerate,
+	Metric_GetDefault,
+	Metric_UpdateState,
+	Metric_SetVolume,
+	Metric_SetVolume,
+	Metric_SetMute,
+	Metric_SetVisibility,
+	Metric_SetDefault,
+};
+
+struct TraceCall {
+	BYTE Op;
+	UINT Device;
+	UINT Value;
+	float Argument;
+	HRESULT Result;
+	UINT Latency;
+
+	// Calls index + 1 of the next call with the same op and device
+	UINT Next;
+};
+
+// Calls index + 1 of the next unreplayed call with this key, 0 for none
+struct TraceChain {
+	UINT Key;
+	UINT Next;
+};
+
+struct TraceEnumeration {
+	UINT Offset;
+	UINT Count;
+	UINT NumDevices;
+	UINT Latency;
+};
+
+struct TraceState {
+	TraceMode Mode;
+	const char* Path;
+	FILE* File;
+
+	BYTE* Data;
+	UINT Size;
+
+	TraceCall* Calls;
+	UINT NumCalls;
+	TraceChain* Chains;
+	UINT NumChains;
+	TraceEnumeration* Enumerations;
+	UINT NumEnumerations;
+	UINT NextEnumeration;
+
+	UINT64 TotalLatency[TraceOp_Count];
+	UINT NumLatencies[TraceOp_Count];
+
+	UINT CallsMade;
+	UINT CallsMatched;
+	LONGLONG Start;
+
+	UINT NumSyntheticDevices;
+	int SyntheticDefaults[ERole_enum_count][2];
+};
+
+static TraceState Trace;
+
+static bool TraceOpHasFloat(BYTE op)
+{
+	return op == TraceOp_SetVolumeScalar || op == TraceOp_SetVolumeLevel;
+}
+
+// 0 is an empty slot, and ops fit in four bits
+static UINT TraceCallKey(BYTE op, UINT device)
+{
+	return (device << 4 | op) + 1;
+}
+
+static TraceChain* FindTraceChain(UINT key)
+{
+	UINT mask = Trace.NumChains - 1;
+	UINT slot = (key * 2654435761u) & mask;
+
+	while (Trace.Chains[slot].Key != 0 && Trace.Chains[slot].Key != key)
+		slot = (slot + 1) & mask;
+
+	return &Trace.Chains[slot];
+}
+
+static void IndexTraceCalls(void)
+{
+	Trace.NumChains = 16;
+	while (Trace.NumChains < Trace.NumCalls * 2)
+		Trace.NumChains *= 2;
+
+	Trace.Chains = (TraceChain*)ArenaAlloc(Trace.NumChains * sizeof(TraceChain));
+
+	// Backwards, so each chain starts at its first recorded call
+	for (UINT i = Trace.NumCalls; i-- > 0;)
+	{
+		TraceCall* call = &Trace.Calls[i];
+		TraceChain* chain = FindTraceChain(TraceCallKey(call->Op, call->Device));
+
+		chain->Key = TraceCallKey(call->Op, call->Device);
+		call->Next = chain->Next;
+		chain->Next = i + 1;
+	}
+}
+
+static void WriteVarint(UINT64 value)
+{
+	do
+	{
+		BYTE byte = value & 0x7F;
+		value >>= 7;
+		fputc(value ? byte | 0x80 : byte, Trace.File);
+	} while (value);
+}
+
+static void WriteFloat(float value)
+{
+	BYTE bytes[4];
+	memcpy(bytes, &value, 4);
+	fwrite(bytes, 1, 4, Trace.File);
+}
+
+static void WriteString(const wchar_t* string)
+{
+	UINT length = (UINT)wcslen(string);
+	WriteVarint(length);
+
+	for (UINT i = 0; i < length; i++)
+	{
+		WriteVarint((UINT)string[i]);
+	}
+}
+
+static UINT64 ReadVarint(UINT* at)
+{
+	UINT64 value = 0;
+	int shift = 0;
+
+	while (*at < Trace.Size)
+	{
+		BYTE byte = Trace.Data[(*at)++];
+		value |= (UINT64)(byte & 0x7F) << shift;
+		shift += 7;
+
+		if (!(byte & 0x80))
+			break;
+	}
+
+	return value;
+}
+
+static float ReadFloat(UINT* at)
+{
+	float value = 0.0f;
+	if (*at + 4 <= Trace.Size)
+		memcpy(&value, Trace.Data + *at, 4);
+
+	*at += 4;
+	return value;
+}
+
+static StringId ReadString(UINT* at)
+{
+	wchar_t string[256];
+	UINT length = (UINT)ReadVarint(at);
+
+	for (UINT i = 0; i < length; i++)
+	{
+		wchar_t c = (wchar_t)ReadVarint(at);
+		if (i < 255)
+			string[i] = c;
+	}
+
+	string[length < 255 ? length : 255] = L'\0';
+	return InternString(string);
+}
+
+static void SkipString(UINT* at)
+{
+	UINT length = (UINT)ReadVarint(at);
+	for (UINT i = 0; i < length; i++)
+	{
+		ReadVarint(at);
+	}
+}
+
+static UINT MicrosecondsSince(LONGLONG start)
+{
+	return (UINT)(MillisecondsSince(start) * 1000.0);
+}
+
+static void WaitMicroseconds(UINT microseconds)
+{
+	// Spin rather than sleep so short latencies are reproduced exactly
+	LONGLONG start = GetTimestamp();
+	while (MillisecondsSince(start) * 1000.0 < microseconds)
+	{
+	}
+}
+
+static bool LoadTrace(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		printf("Unable to open trace %s\n", path);
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	Trace.Size = (UINT)ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (Trace.Size < 5)
+	{
+		printf("Trace %s is empty\n", path);
+		fclose(file);
+		return false;
+	}
+
+	Trace.Data = (BYTE*)ArenaAlloc(Trace.Size);
+	fread(Trace.Data, 1, Trace.Size, file);
+	fclose(file);
+
+	BYTE version = Trace.Data[4];
+	if (memcmp(Trace.Data, "CADT", 4) != 0 || version < 1 || version > TRACE_VERSION)
+	{
+		printf("%s is not a trace of version %i or earlier\n", path, TRACE_VERSION);
+		return false;
+	}
+
+	// Every record is at least four bytes, which bounds the record counts
+	UINT maxRecords = Trace.Size / 4 + 1;
+	Trace.Calls = (TraceCall*)ArenaAlloc(maxRecords * sizeof(TraceCall));
+	Trace.Enumerations = (TraceEnumeration*)ArenaAlloc(maxRecords * sizeof(TraceEnumeration));
+
+	UINT at = 5;
+	while (at < Trace.Size)
+	{
+		BYTE op = Trace.Data[at++];
+		UINT latency;
+
+		if (op == TraceOp_Enumerate)
+		{
+			TraceEnumeration* enumeration = &Trace.Enumerations[Trace.NumEnumerations++];
+			enumeration->Count = (UINT)ReadVarint(&at);
+			enumeration->NumDevices = version == 1 ? (UINT)ReadVarint(&at) : enumeration->Count;
+			enumeration->Offset = at;
+
+			for (UINT i = 0; i < enumeration->NumDevices && at <= Trace.Size; i++)
+			{
+				SkipString(&at);
+				SkipString(&at);
+				at += 2 + 4 + 4 + 1;
+			}
+
+			if (at > Trace.Size)
+			{
+				printf("Trace %s ends inside an enumeration\n", path);
+				return false;
+			}
+
+			enumeration->Latency = latency = (UINT)ReadVarint(&at);
+
+			// Older traces recorded overflowing enumerations without devices
+			if (enumeration->NumDevices < enumeration->Count)
+				Trace.NumEnumerations--;
+		}
+		else if (op < TraceOp_Count)
+		{
+			TraceCall* call = &Trace.Calls[Trace.NumCalls++];
+			call->Op = op;
+			call->Device = (UINT)ReadVarint(&at);
+
+			if (op == TraceOp_GetDefault)
+			{
+				call->Value = (UINT)ReadVarint(&at);
+			}
+			else
+			{
+				if (TraceOpHasFloat(op))
+					call->Argument = ReadFloat(&at);
+				else
+					call->Value = (UINT)ReadVarint(&at);
+
+				call->Result = (HRESULT)(UINT)ReadVarint(&at);
+			}
+
+			call->Latency = latency = (UINT)ReadVarint(&at);
+		}
+		else
+		{
+			printf("Trace %s is corrupt at byte %u\n", path, at - 1);
+			return false;
+		}
+
+		Trace.TotalLatency[op] += latency;
+		Trace.NumLatencies[op]++;
+	}
+
+	IndexTraceCalls();
+
+	printf("Replaying %u enumerations and %u calls from %s\n", Trace.NumEnumerations, Trace.NumCalls, path);
+	return Trace.NumEnumerations > 0;
+}
+
+static bool StartTrace(TraceMode mode, const char* path)
+{
+	Trace.Mode = mode;
+	Trace.Path = path;
+	Trace.Start = GetTimestamp();
+
+	if (mode == TraceMode_Replay)
+		return LoadTrace(path);
+
+	Trace.File = fopen(path, "wb");
+	if (Trace.File == NULL)
+	{
+		printf("Unable to create trace %s\n", path);
+		return false;
+	}
+
+	fwrite("CADT", 1, 4, Trace.File);
+	fputc(TRACE_VERSION, Trace.File);
+
+	return true;
+}
+
+static void FinishTrace(void)
+{
+	if (Trace.Mode == TraceMode_Record)
+	{
+		fclose(Trace.File);
+		printf("Recorded %u calls to %s\n", Trace.CallsMade, Trace.Path);
+	}
+	else if (Trace.Mode == TraceMode_Replay)
+	{
+		printf("Replayed %u calls (%u matched the trace) in %.3f ms\n",
+			Trace.CallsMade, Trace.CallsMatched, MillisecondsSince(Trace.Start));
+	}
+}
+
+static void RecordCall(BYTE op, UINT device, UINT value, float argument, HRESULT result, LONGLONG start)
+{
+	UINT latency = MicrosecondsSince(start);
+
+	Trace.CallsMade++;
+	fputc(op, Trace.File);
+	WriteVarint(device);
+
+	if (op == TraceOp_GetDefault)
+	{
+		WriteVarint(value);
+	}
+	else
+	{
+		if (TraceOpHasFloat(op))
+			WriteFloat(argument);
+		else
+			WriteVarint(value);
+
+		WriteVarint((UINT)result);
+	}
+
+	WriteVarint(latency);
+}
+
+static TraceCall* ReplayCall(BYTE op, UINT device)
+{
+	Trace.CallsMade++;
+
+	TraceChain* chain = FindTraceChain(TraceCallKey(op, device));
+	if (chain->Next)
+	{
+		TraceCall* call = &Trace.Calls[chain->Next - 1];
+		chain->Next = call->Next;
+
+		Trace.CallsMatched++;
+
+		LONGLONG start = GetTimestamp();
+		WaitMicroseconds(call->Latency);
+		RecordMetric(TraceOpMetrics[op], start, op == TraceOp_GetDefault ? S_OK : call->Result);
+
+		return call;
+	}
+
+	LONGLONG start = GetTimestamp();
+	if (Trace.NumLatencies[op])
+		WaitMicroseconds((UINT)(Trace.TotalLatency[op] / Trace.NumLatencies[op]));
+	RecordMetric(TraceOpMetrics[op], start, S_OK);
+
+	return NULL;
+}
+
+static void StartSyntheticDevices(UINT numDevices)
+{
+	Trace.Mode = TraceMode_Synthetic;
+	Trace.NumSyntheticDevices = numDevices;
+}
+
+static UINT EnumerateSyntheticDevices(Device* devices, UINT maxDevices)
+{
+	UINT count = Trace.NumSyntheticDevices;
+	if (count > maxDevices)
+		return count;
+
+	ReserveStrings(count * 2, count * 96);
+
+	wchar_t id[64];
+	wchar_t name[160];
+
+	for (UINT i = 0; i < count; i++)
+	{
+		DeviceInfo* info = &devices[i].Info;
+
+		swprintf(id, 64, L"{0.0.%u.00000000}.{%08x-synthetic}", i % 2, i);
+
+		// A mix of preset targets, ordinary names and long runs of one
+		// character that make star-heavy patterns backtrack
+		switch (i % 8)
+		{
+		case 0: swprintf(name, 160, L"Astro Game Headset %u", i); break;
+		case 1: swprintf(name, 160, L"Astro Voice Mic %u", i); break;
+		case 2: swprintf(name, 160, L"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa %u", i); break;
+		case 3: swprintf(name, 160, L"Microphone (Synthetic Audio %u)", i); break;
+		default: swprintf(name, 160, L"Speakers (Synthetic Audio %u)", i); break;
+		}
+
+		info->Id = InternString(id);
+		info->Name = InternString(name);
+		info->DataFlow = (EDataFlow)((i + i / 8) % 2);
+		info->State = i % 5 == 4 ? DEVICE_STATE_DISABLED : DEVICE_STATE_ACTIVE;
+		info->VolumeScalar = 0.5f;
+		info->VolumeLevel = -10.0f;
+		info->HasVolume = true;
+	}
+
+	for (int role = 0; role < ERole_enum_count; role++)
+	{
+		Trace.SyntheticDefaults[role][eRender] = count > 0 ? 0 : -1;
+		Trace.SyntheticDefaults[role][eCapture] = count > 1 ? 1 : -1;
+	}
+
+	return count;
+}
+
+static UINT DeviceIndexOf(Device* device)
+{
+	return (UINT)(device - AllDevices);
+}
+
+static UINT EndpointEnumerate(Device* devices, UINT maxDevices)
+{
+	if (Trace.Mode == TraceMode_Replay)
+	{
+		// Only advance once the caller has room, it enumerates again if not
+		TraceEnumeration* enumeration = &Trace.Enumerations[Trace.NextEnumeration];
+		if (enumeration->Count > maxDevices)
+			return enumeration->Count;
+
+		if (Trace.NextEnumeration + 1 < Trace.NumEnumerations)
+			Trace.NextEnumeration++;
+
+		UINT at = enumeration->Offset;
+		for (UINT i = 0; i < enumeration->NumDevices; i++)
+		{
+			DeviceInfo* info = &devices[i].Info;
+			info->Id = ReadString(&at);
+			info->Name = ReadString(&at);
+
+			// LoadTrace checked the record, this only guards the reads
+			if (at + 2 + 4 + 4 + 1 > Trace.Size)
+			{
+				printf("Trace %s is corrupt, replaying no devices\n", Trace.Path);
+				return 0;
+			}
+
+			info->DataFlow = (EDataFlow)Trace.Data[at++];
+			info->State = Trace.Data[at++];
+			info->VolumeScalar = ReadFloat(&at);
+			info->VolumeLevel = ReadFloat(&at);
+			info->IsMute = Trace.Data[at++];
+
+			// Backends only read the volume of active endpoints
+			info->HasVolume = info->State == DEVICE_STATE_ACTIVE;
+		}
+
+		Trace.CallsMade++;
+		Trace.CallsMatched++;
+
+		LONGLONG start = GetTimestamp();
+		WaitMicroseconds(enumeration->Latency);
+		RecordMetric(Metric_Enumerate, start, S_OK);
+
+		return enumeration->Count;
+	}
+
+	if (Trace.Mode == TraceMode_Synthetic)
+		return EnumerateSyntheticDevices(devices, maxDevices);
+
+	LONGLONG start = GetTimestamp();
+	UINT count = PlatformEnumerateDevices(devices, maxDevices);
+	RecordMetric(Metric_Enumerate, start, S_OK);
+
+	if (Trace.Mode == TraceMode_Record && count <= maxDevices)
+	{
+		UINT latency = MicrosecondsSince(start);
+
+		Trace.CallsMade++;
+		fputc(TraceOp_Enumerate, Trace.File);
+		WriteVarint(count);
+
+		for (UINT i = 0; i < count; i++)
+		{
+			DeviceInfo* info = &devices[i].Info;
+			WriteString(StringText(info->Id));
+			WriteString(StringText(info->Name));
+			fputc(info->DataFlow, Trace.File);
+			fputc(info->State, Trace.File);
+			WriteFloat(info->VolumeScalar);
+			WriteFloat(info->VolumeLevel);
+			fputc(info->IsMute ? 1 : 0, Trace.File);
+		}
+
+		WriteVarint(latency);
+	}
+
+	return count;
+}
+
+static StringId EndpointGetDefault(ERole role, EDataFlow dataFlow)
+{
+	UINT key = role * 2 + dataFlow;
+
+	if (Trace.Mode == TraceMode_Replay)
+	{
+		TraceCall* call = ReplayCall(TraceOp_GetDefault, key);
+		if (call == NULL || call->Value == 0 || call->Value > NumDevices)
+			return STRING_ID_NONE;
+
+		return AllDevices[call->Value - 1].Info.Id;
+	}
+
+	if (Trace.Mode == TraceMode_Synthetic)
+	{
+		int index = Trace.SyntheticDefaults[role][dataFlow];
+		return index >= 0 && index < NumDevices ? AllDevices[index].Info.Id : STRING_ID_NONE;
+	}
+
+	LONGLONG start = GetTimestamp();
+	StringId id = PlatformGetDefaultDevice(role, dataFlow);
+	RecordMetric(Metric_GetDefault, start, S_OK);
+
+	if (Trace.Mode == TraceMode_Record)
+		RecordCall(TraceOp_GetDefault, key, FindDeviceIndex(id) + 1, 0.0f, S_OK, start);
+
+	return id;
+}
+
+static HRESULT EndpointUpdateState(Device* device)
+{
+	if (Trace.Mode == TraceMode_Replay)
+	{
+		TraceCall* call = ReplayCall(TraceOp_UpdateState, DeviceIndexOf(device));
+		if (call == NULL)
+			return S_OK;
+
+		// The trace has no volume for an endpoint that became active
+		if (call->Value != device->Info.State)
+			device->Info.HasVolume = false;
+		device->Info.State = call->Value;
+		return call->Result;
+	}
+
+	if (Trace.Mode == TraceMode_Synthetic)
+		return S_OK;
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformUpdateState(device);
+	RecordMetric(Metric_UpdateState, start, result);
+
+	if (Trace.Mode == TraceMode_Record)
+		RecordCall(TraceOp_UpdateState, DeviceIndexOf(device), device->Info.State, 0.0f, result, start);
+
+	return result;
+}
+
+static HRESULT ReplayResult(BYTE op, Device* device)
+{
+	TraceCall* call = ReplayCall(op, DeviceIndexOf(device));
+	return call ? call->Result : S_OK;
+}
+
+static HRESULT EndpointSetVolumeScalar(Device* device, float volumeScalar)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return ReplayResult(TraceOp_SetVolumeScalar, device);
+
+	if (Trace.Mode == TraceMode_Synthetic)
+	{
+		device->Info.VolumeScalar = volumeScalar;
+		return S_OK;
+	}
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformSetVolumeScalar(device, volumeScalar);
+	RecordMetric(Metric_SetVolume, start, result);
+
+	if (Trace.Mode == TraceMode_Record)
+		RecordCall(TraceOp_SetVolumeScalar, DeviceIndexOf(device), 0, volumeScalar, result, start);
+
+	return result;
+}
+
+static HRESULT EndpointSetVolumeLevel(Device* device, float volumeLevel)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return ReplayResult(TraceOp_SetVolumeLevel, device);
+
+	if (Trace.Mode == TraceMode_Synthetic)
+	{
+		device->Info.VolumeLevel = volumeLevel;
+		return S_OK;
+	}
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformSetVolumeLevel(device, volumeLevel);
+	RecordMetric(Metric_SetVolume, start, result);
+
+	if (Trace.Mode == TraceMode_Record)
+		RecordCall(TraceOp_SetVolumeLevel, DeviceIndexOf(device), 0, volumeLevel, result, start);
+
+	return result;
+}
+
+static HRESULT EndpointSetMute(Device* device, BOOL mute)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return ReplayResult(TraceOp_SetMute, device);
+
+	if (Trace.Mode == TraceMode_Synthetic)
+	{
+		device->Info.IsMute = mute;
+		return S_OK;
+	}
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformSetMute(device, mute);
+	RecordMetric(Metric_SetMute, start, result);
+
+	if (Trace.Mode == TraceMode_Record)
+		RecordCall(TraceOp_SetMute, DeviceIndexOf(device), mute ? 1 : 0, 0.0f, result, start);
+
+	return result;
+}
+
+static HRESULT EndpointSetVisibility(Device* device, bool visible)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return ReplayResult(TraceOp_SetVisibility, device);
+
+	if (Trace.Mode == TraceMode_Synthetic)
+		return S_OK;
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformSetVisibility(device, visible);
+	RecordMetric(Metric_SetVisibility, start, result);
+
+	if (Trace.Mode == TraceMode_Record)
+		RecordCall(TraceOp_SetVisibility, DeviceIndexOf(device), visible ? 1 : 0, 0.0f, result, start);
+
+	return result;
+}
+
+static HRESULT EndpointSetDefault(Device* device, ERole role)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return ReplayResult(TraceOp_SetDefault, device);
+
+	if (Trace.Mode == TraceMode_Synthetic)
+	{
+		Trace.SyntheticDefaults[role][device->Info.DataFlow] = DeviceIndexOf(device);
+		return S_OK;
+	}
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformSetDefault(device, role);
+	RecordMetric(Metric_SetDefault, start, result);
+
+	if (Trace.Mode == TraceMode_Record)
+		RecordCall(TraceOp_SetDefault, DeviceIndexOf(device), role, 0.0f, result, start);
+
+	return result;
+}
+
+// Live volume reads are not part of a trace. The backend records the metric.
+static HRESULT EndpointReadVolume(Device* device)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return E_NOTIMPL;
+	if (Trace.Mode == TraceMode_Synthetic)
+		return S_OK;
+
+	return PlatformReadVolume(device);
+}
+
+static HRESULT EndpointReadDetails(Device* device, DeviceDetails* details)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return E_NOTIMPL;
+
+	if (Trace.Mode == TraceMode_Synthetic)
+	{
+		details->FormFactor = device->Info.DataFlow == eCapture ? Microphone : Speakers;
+		details->Bus = Bus_Virtual;
+		details->Stamp = 1;
+		return S_OK;
+	}
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformReadDetails(device, details);
+	RecordMetric(Metric_ReadDetails, start, result);
+	return result;
+}
+
+static HRESULT EndpointQueryFormat(Device* device, DeviceDetails* details)
+{
+	if (Trace.Mode == TraceMode_Replay)
+		return E_NOTIMPL;
+
+	if (Trace.Mode == TraceMode_Synthetic)
+	{
+		details->SampleRate = 48000;
+		details->Channels = 2;
+		details->BitsPerSample = 32;
+		details->DefaultPeriod = 100000;
+		details->MinimumPeriod = 30000;
+		details->Flags |= DETAILS_FLOAT;
+		return S_OK;
+	}
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = PlatformQueryFormat(device, details);
+	RecordMetric(Metric_QueryFormat, start, result);
+	return result;
+}
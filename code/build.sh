@@ -0,0 +1,5 @@
+#!/bin/sh
+
+mkdir -p ../build
+cd ../build
+c++ -g ../code/audio.cpp -o audio -lpulse -lpulse-simple -lpthread
@@ -0,0 +1,497 @@
+// Linux backend, included by audio.cpp after the shared device types.
+//
+// Enumeration asks for the server info, every sink and every source in one
+// batch and waits for all three replies, instead of querying per device.
+// PulseAudio has no hidden endpoints and no separate communications default,
+// so visibility is not implemented and the communications role is ignored
+// when setting defaults.
+//
+// To try it without hardware:
+//
+//     pactl load-module module-null-sink sink_name=game sink_properties=device.description=Astro_Game
+//     pactl load-module module-null-source source_name=mic source_properties=device.description=Astro_Voice
+
+static pa_mainloop* Mainloop;
+static pa_context* Context;
+
+struct EnumerateState {
+	Device* Devices;
+	UINT MaxDevices;
+	UINT Count;
+};
+
+static void WaitForOperation(pa_operation* operation)
+{
+	if (operation == NULL)
+		return;
+
+	while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING)
+	{
+		if (pa_mainloop_iterate(Mainloop, 1, NULL) < 0)
+			break;
+	}
+
+	pa_operation_unref(operation);
+}
+
+static void SuccessCallback(pa_context* context, int success, void* userdata)
+{
+	*(HRESULT*)userdata = success ? S_OK : E_FAIL;
+}
+
+static HRESULT WaitForSuccess(pa_operation* operation, HRESULT* result)
+{
+	if (operation == NULL)
+		return E_FAIL;
+
+	WaitForOperation(operation);
+	return *result;
+}
+
+static StringId InternNarrowString(const char* string)
+{
+	wchar_t wide[256];
+	if (string == NULL || mbstowcs(wide, string, 256) == (size_t)-1)
+		return STRING_ID_NONE;
+
+	wide[255] = L'\0';
+	return InternString(wide);
+}
+
+static bool PlatformInitialize(void)
+{
+	// Device names are UTF-8
+	setlocale(LC_ALL, "");
+
+	Mainloop = pa_mainloop_new();
+	Context = pa_context_new(pa_mainloop_get_api(Mainloop), "CAudioDevices");
+
+	if (pa_context_connect(Context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+		return false;
+
+	for (;;)
+	{
+		pa_context_state_t state = pa_context_get_state(Context);
+		if (state == PA_CONTEXT_READY)
+			return true;
+		if (!PA_CONTEXT_IS_GOOD(state))
+			return false;
+
+		pa_mainloop_iterate(Mainloop, 1, NULL);
+	}
+}
+
+static void PlatformShutdown(void)
+{
+	if (Context)
+	{
+		pa_context_disconnect(Context);
+		pa_context_unref(Context);
+		Context = NULL;
+	}
+
+	if (Mainloop)
+	{
+		pa_mainloop_free(Mainloop);
+		Mainloop = NULL;
+	}
+}
+
+static Device* AddDevice(EnumerateState* state)
+{
+	// Keep counting past the limit so the caller can report the real total
+	UINT index = state->Count++;
+	if (index >= state->MaxDevices)
+		return NULL;
+
+	return &state->Devices[index];
+}
+
+static void PopulateVolume(Device* device, const pa_cvolume* volume, int mute)
+{
+	pa_volume_t average = pa_cvolume_avg(volume);
+
+	device->Info.VolumeScalar = (float)average / (float)PA_VOLUME_NORM;
+	device->Info.VolumeLevel = average == PA_VOLUME_MUTED ? -96.0f : (float)pa_sw_volume_to_dB(average);
+	device->Info.IsMute = mute;
+	device->Info.HasVolume = true;
+
+	device->Platform.Channels = volume->channels;
+}
+
+static BYTE FormFactorFromProperty(const char* formFactor)
+{
+	if (formFactor == NULL)
+		return UnknownFormFactor;
+
+	if (strcmp(formFactor, "speaker") == 0 || strcmp(formFactor, "computer") == 0 || strcmp(formFactor, "hifi") == 0)
+		return Speakers;
+	if (strcmp(formFactor, "headphone") == 0)
+		return Headphones;
+	if (strcmp(formFactor, "headset") == 0 || strcmp(formFactor, "hands-free") == 0)
+		return Headset;
+	if (strcmp(formFactor, "handset") == 0)
+		return Handset;
+	if (strcmp(formFactor, "microphone") == 0 || strcmp(formFactor, "webcam") == 0)
+		return Microphone;
+	if (strcmp(formFactor, "tv") == 0)
+		return DigitalAudioDisplayDevice;
+
+	return UnknownFormFactor;
+}
+
+static BYTE BusFromProperty(const char* bus)
+{
+	// Null sinks, loopbacks and network sinks have no bus
+	if (bus == NULL)
+		return Bus_Virtual;
+
+	if (strcmp(bus, "pci") == 0 || strcmp(bus, "isa") == 0)
+		return Bus_Internal;
+	if (strcmp(bus, "usb") == 0)
+		return Bus_Usb;
+	if (strcmp(bus, "bluetooth") == 0)
+		return Bus_Bluetooth;
+
+	return Bus_Unknown;
+}
+
+// The replies carry the details, so they are kept instead of asked for again
+static void PopulateDetails(Device* device, const pa_sample_spec* sampleSpec, pa_usec_t latency, pa_proplist* properties)
+{
+	PlatformDevice* platform = &device->Platform;
+
+	platform->SampleSpec = *sampleSpec;
+	platform->Latency = latency;
+	platform->FormFactor = FormFactorFromProperty(pa_proplist_gets(properties, PA_PROP_DEVICE_FORM_FACTOR));
+	platform->Bus = BusFromProperty(pa_proplist_gets(properties, PA_PROP_DEVICE_BUS));
+}
+
+static DWORD PortState(pa_port_info* activePort)
+{
+	if (activePort && activePort->available == PA_PORT_AVAILABLE_NO)
+		return DEVICE_STATE_UNPLUGGED;
+	return DEVICE_STATE_ACTIVE;
+}
+
+static void SinkCallback(pa_context* context, const pa_sink_info* info, int eol, void* userdata)
+{
+	if (eol)
+		return;
+
+	Device* device = AddDevice((EnumerateState*)userdata);
+	if (device == NULL)
+		return;
+
+	device->Info.Id = InternNarrowString(info->name);
+	device->Info.Name = InternNarrowString(info->description);
+	device->Info.DataFlow = eRender;
+	device->Info.State = PortState(info->active_port);
+	device->Platform.Index = info->index;
+	PopulateVolume(device, &info->volume, info->mute);
+	PopulateDetails(device, &info->sample_spec, info->configured_latency, info->proplist);
+}
+
+static void SourceCallback(pa_context* context, const pa_source_info* info, int eol, void* userdata)
+{
+	// Monitors of sinks are not recording endpoints
+	if (eol || info->monitor_of_sink != PA_INVALID_INDEX)
+		return;
+
+	Device* device = AddDevice((EnumerateState*)userdata);
+	if (device == NULL)
+		return;
+
+	device->Info.Id = InternNarrowString(info->name);
+	device->Info.Name = InternNarrowString(info->description);
+	device->Info.DataFlow = eCapture;
+	device->Info.State = PortState(info->active_port);
+	device->Platform.Index = info->index;
+	PopulateVolume(device, &info->volume, info->mute);
+	PopulateDetails(device, &info->sample_spec, info->configured_latency, info->proplist);
+}
+
+static StringId DefaultDeviceIds[2];
+
+static void ServerInfoCallback(pa_context* context, const pa_server_info* info, void* userdata)
+{
+	// NULL when the query failed. The old Ids belong to strings that were
+	// reset, so there is no default rather than a stale one.
+	if (info == NULL)
+	{
+		DefaultDeviceIds[eRender] = STRING_ID_NONE;
+		DefaultDeviceIds[eCapture] = STRING_ID_NONE;
+		return;
+	}
+
+	// Interned now so the default Ids compare equal to the device Ids
+	DefaultDeviceIds[eRender] = InternNarrowString(info->default_sink_name);
+	DefaultDeviceIds[eCapture] = InternNarrowString(info->default_source_name);
+}
+
+static UINT PlatformEnumerateDevices(Device* devices, UINT maxDevices)
+{
+	EnumerateState state = {};
+	state.Devices = devices;
+	state.MaxDevices = maxDevices;
+
+	pa_operation* operations[3];
+	operations[0] = pa_context_get_server_info(Context, ServerInfoCallback, NULL);
+	operations[1] = pa_context_get_sink_info_list(Context, SinkCallback, &state);
+	operations[2] = pa_context_get_source_info_list(Context, SourceCallback, &state);
+
+	for (int i = 0; i < 3; i++)
+	{
+		WaitForOperation(operations[i]);
+	}
+
+	return state.Count;
+}
+
+static void PlatformReleaseDevice(Device* device)
+{
+	device->Platform = {};
+}
+
+static StringId PlatformGetDefaultDevice(ERole role, EDataFlow dataFlow)
+{
+	return DefaultDeviceIds[dataFlow];
+}
+
+static HRESULT PlatformUpdateState(Device* device)
+{
+	// States only change on hotplug, which re-enumerates
+	return S_OK;
+}
+
+struct ReadVolumeState {
+	Device* Target;
+	HRESULT Result;
+};
+
+static void SinkVolumeCallback(pa_context* context, const pa_sink_info* info, int eol, void* userdata)
+{
+	ReadVolumeState* state = (ReadVolumeState*)userdata;
+	if (eol || info == NULL)
+		return;
+
+	PopulateVolume(state->Target, &info->volume, info->mute);
+	state->Result = S_OK;
+}
+
+static void SourceVolumeCallback(pa_context* context, const pa_source_info* info, int eol, void* userdata)
+{
+	ReadVolumeState* state = (ReadVolumeState*)userdata;
+	if (eol || info == NULL)
+		return;
+
+	PopulateVolume(state->Target, &info->volume, info->mute);
+	state->Result = S_OK;
+}
+
+static HRESULT PlatformReadVolume(Device* device)
+{
+	ReadVolumeState state = {device, E_FAIL};
+	LONGLONG start = GetTimestamp();
+
+	pa_operation* operation;
+	if (device->Info.DataFlow == eRender)
+		operation = pa_context_get_sink_info_by_index(Context, device->Platform.Index, SinkVolumeCallback, &state);
+	else
+		operation = pa_context_get_source_info_by_index(Context, device->Platform.Index, SourceVolumeCallback, &state);
+
+	if (operation)
+		WaitForOperation(operation);
+
+	RecordMetric(Metric_GetVolume, start, state.Result);
+	return state.Result;
+}
+
+static HRESULT SetVolume(Device* device, pa_volume_t volume)
+{
+	pa_cvolume channels;
+	pa_cvolume_set(&channels, device->Platform.Channels ? device->Platform.Channels : 1, volume);
+
+	HRESULT result = E_FAIL;
+	pa_operation* operation;
+
+	if (device->Info.DataFlow == eRender)
+		operation = pa_context_set_sink_volume_by_index(Context, device->Platform.Index, &channels, SuccessCallback, &result);
+	else
+		operation = pa_context_set_source_volume_by_index(Context, device->Platform.Index, &channels, SuccessCallback, &result);
+
+	return WaitForSuccess(operation, &result);
+}
+
+static HRESULT PlatformSetVolumeScalar(Device* device, float volumeScalar)
+{
+	return SetVolume(device, (pa_volume_t)(volumeScalar * PA_VOLUME_NORM));
+}
+
+static HRESULT PlatformSetVolumeLevel(Device* device, float volumeLevel)
+{
+	return SetVolume(device, pa_sw_volume_from_dB(volumeLevel));
+}
+
+static HRESULT PlatformSetMute(Device* device, BOOL mute)
+{
+	HRESULT result = E_FAIL;
+	pa_operation* operation;
+
+	if (device->Info.DataFlow == eRender)
+		operation = pa_context_set_sink_mute_by_index(Context, device->Platform.Index, mute, SuccessCallback, &result);
+	else
+		operation = pa_context_set_source_mute_by_index(Context, device->Platform.Index, mute, SuccessCallback, &result);
+
+	return WaitForSuccess(operation, &result);
+}
+
+static HRESULT PlatformSetVisibility(Device* device, bool visible)
+{
+	return E_NOTIMPL;
+}
+
+static HRESULT PlatformSetDefault(Device* device, ERole role)
+{
+	if (role == eCommunications)
+		return S_FALSE;
+
+	char name[256];
+	if (wcstombs(name, StringText(device->Info.Id), sizeof(name)) == (size_t)-1)
+		return E_FAIL;
+	name[255] = '\0';
+
+	HRESULT result = E_FAIL;
+	pa_operation* operation;
+
+	if (device->Info.DataFlow == eRender)
+		operation = pa_context_set_default_sink(Context, name, SuccessCallback, &result);
+	else
+		operation = pa_context_set_default_source(Context, name, SuccessCallback, &result);
+
+	return WaitForSuccess(operation, &result);
+}
+
+static HRESULT PlatformReadDetails(Device* device, DeviceDetails* details)
+{
+	PlatformDevice* platform = &device->Platform;
+
+	details->FormFactor = platform->FormFactor;
+	details->Bus = platform->Bus;
+
+	UINT stamp = HashBytes(2166136261u, &platform->SampleSpec, sizeof(platform->SampleSpec));
+	stamp = HashBytes(stamp, &platform->Latency, sizeof(platform->Latency));
+	details->Stamp = HashBytes(stamp, &device->Info.State, sizeof(device->Info.State));
+
+	return S_OK;
+}
+
+static HRESULT PlatformQueryFormat(Device* device, DeviceDetails* details)
+{
+	const pa_sample_spec* sampleSpec = &device->Platform.SampleSpec;
+
+	details->SampleRate = sampleSpec->rate;
+	details->Channels = sampleSpec->channels;
+	details->BitsPerSample = (WORD)(pa_sample_size(sampleSpec) * 8);
+
+	if (sampleSpec->format == PA_SAMPLE_FLOAT32LE || sampleSpec->format == PA_SAMPLE_FLOAT32BE)
+		details->Flags |= DETAILS_FLOAT;
+
+	// The server picks one latency per device, there is no separate minimum
+	details->DefaultPeriod = (LONGLONG)device->Platform.Latency * 10;
+	details->MinimumPeriod = 0;
+
+	return S_OK;
+}
+
+static void* LevelStreamThread(void* parameter)
+{
+	LevelStream* stream = (LevelStream*)parameter;
+	PlatformLevelStream* platform = &stream->Platform;
+
+	// 10 ms reads, or as much of it as fits
+	float samples[4096];
+	UINT count = stream->SampleRate / 100 * stream->Channels;
+	if (count > 4096)
+		count = 4096;
+
+	while (!platform->Stop)
+	{
+		int error;
+		if (pa_simple_read(platform->Simple, samples, count * sizeof(float), &error) < 0)
+			break;
+
+		WriteRing(&stream->Ring, samples, count);
+	}
+
+	return NULL;
+}
+
+static bool PlatformStartLevelStream(Device* device, LevelStream* stream)
+{
+	PlatformLevelStream* platform = &stream->Platform;
+
+	// Render endpoints are heard through their sink's monitor source
+	char name[300];
+	if (wcstombs(name, StringText(device->Info.Id), 256) == (size_t)-1)
+		return false;
+	name[255] = '\0';
+	if (device->Info.DataFlow == eRender)
+		strcat(name, ".monitor");
+
+	pa_sample_spec sampleSpec;
+	sampleSpec.format = PA_SAMPLE_FLOAT32LE;
+	sampleSpec.rate = device->Platform.SampleSpec.rate ? device->Platform.SampleSpec.rate : 48000;
+	sampleSpec.channels = device->Platform.SampleSpec.channels ? device->Platform.SampleSpec.channels : 2;
+
+	stream->Channels = sampleSpec.channels;
+	stream->SampleRate = sampleSpec.rate;
+
+	// Monitors carry the sink after its volume and mute
+	stream->PostGain = true;
+
+	pa_buffer_attr bufferAttributes;
+	bufferAttributes.maxlength = (uint32_t)-1;
+	bufferAttributes.tlength = (uint32_t)-1;
+	bufferAttributes.prebuf = (uint32_t)-1;
+	bufferAttributes.minreq = (uint32_t)-1;
+	bufferAttributes.fragsize = sampleSpec.rate / 100 * sampleSpec.channels * sizeof(float);
+
+	int error;
+	platform->Simple = pa_simple_new(NULL, "CAudioDevices", PA_STREAM_RECORD, name, "Level meter", &sampleSpec, NULL, &bufferAttributes, &error);
+	if (platform->Simple == NULL)
+		return false;
+
+	if (pthread_create(&platform->Thread, NULL, LevelStreamThread, stream) != 0)
+	{
+		pa_simple_free(platform->Simple);
+		platform->Simple = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static void PlatformStopLevelStream(LevelStream* stream)
+{
+	PlatformLevelStream* platform = &stream->Platform;
+	if (platform->Simple == NULL)
+		return;
+
+	// The thread sees Stop after its current read, at most 10 ms
+	InterlockedExchange(&platform->Stop, 1);
+	pthread_join(platform->Thread, NULL);
+
+	pa_simple_free(platform->Simple);
+	platform->Simple = NULL;
+}
+
+static void PlatformRunConcurrently(int count, PlatformWork work, void* context)
+{
+	// One mainloop serves every call, so they run in turn. Each call is a
+	// local round trip to the server.
+	for (int i = 0; i < count; i++)
+	{
+		work(i, context);
+	}
+}
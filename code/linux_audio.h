@@ -0,0 +1,154 @@
+#pragma once
+
+// Linux backend types: PulseAudio (or PipeWire's pulse server) through
+// libpulse. Sinks map to render endpoints and sources to capture endpoints.
+//
+// The shared code is written against the Windows base types and Core Audio
+// enums, so the subset it uses is defined here.
+
+#include <stdint.h>
+#include <wchar.h>
+#include <locale.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <pulse/pulseaudio.h>
+#include <pulse/simple.h>
+
+#define CONFIG_PATH "config.txt"
+#define DETAILS_PATH "details.txt"
+
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef int32_t LONG;
+typedef int64_t LONGLONG;
+typedef uint64_t UINT64;
+typedef size_t SIZE_T;
+typedef int32_t HRESULT;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCWSTR;
+
+#define TRUE 1
+#define FALSE 0
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_POINTER ((HRESULT)0x80004003)
+#define E_FAIL ((HRESULT)0x80004005)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+enum EDataFlow {
+	eRender,
+	eCapture,
+	eAll,
+	EDataFlow_enum_count
+};
+
+enum ERole {
+	eConsole,
+	eMultimedia,
+	eCommunications,
+	ERole_enum_count
+};
+
+enum EndpointFormFactor {
+	RemoteNetworkDevice,
+	Speakers,
+	LineLevel,
+	Headphones,
+	Microphone,
+	Headset,
+	Handset,
+	UnknownDigitalPassthrough,
+	SPDIF,
+	DigitalAudioDisplayDevice,
+	UnknownFormFactor,
+	EndpointFormFactor_enum_count
+};
+
+#define DEVICE_STATE_ACTIVE 0x00000001
+#define DEVICE_STATE_DISABLED 0x00000002
+#define DEVICE_STATE_NOTPRESENT 0x00000004
+#define DEVICE_STATE_UNPLUGGED 0x00000008
+
+#define MEM_COMMIT 0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+#define PAGE_READWRITE 0x04
+
+// Anonymous mappings are zeroed like VirtualAlloc. The size is stored in
+// front of the block because munmap needs it and VirtualFree does not.
+inline void* VirtualAlloc(void* address, SIZE_T size, DWORD allocationType, DWORD protect)
+{
+	SIZE_T* block = (SIZE_T*)mmap(address, size + 16, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (block == MAP_FAILED)
+		return NULL;
+
+	block[0] = size + 16;
+	return (char*)block + 16;
+}
+
+inline BOOL VirtualFree(void* address, SIZE_T size, DWORD freeType)
+{
+	char* block = (char*)address - 16;
+	return munmap(block, *(SIZE_T*)block) == 0;
+}
+
+inline LONG InterlockedIncrement(volatile LONG* value) { return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(volatile LONG* value) { return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(volatile LONG* target, LONG value) { return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedOr(volatile LONG* target, LONG value) { return __atomic_fetch_or(target, value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedAnd(volatile LONG* target, LONG value) { return __atomic_fetch_and(target, value, __ATOMIC_SEQ_CST); }
+inline LONG ReadAcquire(const volatile LONG* source) { return __atomic_load_n(source, __ATOMIC_ACQUIRE); }
+inline void WriteRelease(volatile LONG* destination, LONG value) { __atomic_store_n(destination, value, __ATOMIC_RELEASE); }
+inline LONGLONG InterlockedExchangeAdd64(volatile LONGLONG* target, LONGLONG value) { return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST); }
+
+union LARGE_INTEGER {
+	LONGLONG QuadPart;
+};
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* counter)
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	counter->QuadPart = (LONGLONG)now.tv_sec * 1000000000LL + now.tv_nsec;
+	return TRUE;
+}
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+	frequency->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+inline void Sleep(DWORD milliseconds)
+{
+	timespec duration = { (time_t)(milliseconds / 1000), (long)(milliseconds % 1000) * 1000000 };
+	nanosleep(&duration, NULL);
+}
+
+inline int lstrlenW(LPCWSTR string) { return (int)wcslen(string); }
+inline int lstrcmpW(LPCWSTR a, LPCWSTR b) { return wcscmp(a, b); }
+
+struct PlatformDevice {
+	uint32_t Index;
+	uint8_t Channels;
+
+	// Copied from the sink or source info for PlatformReadDetails
+	pa_sample_spec SampleSpec;
+	pa_usec_t Latency;
+	uint8_t FormFactor;
+	uint8_t Bus;
+};
+
+// A blocking simple-API connection per stream, read on its own thread
+struct PlatformLevelStream {
+	pa_simple* Simple;
+	pthread_t Thread;
+	volatile LONG Stop;
+};
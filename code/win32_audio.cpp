@@ -0,0 +1,532 @@
+// Windows backend, included by audio.cpp after the shared device types.
+
+ComHandle<IMMDeviceEnumerator> DeviceEnumerator;
+ComHandle<IPolicyConfig> PolicyConfig;
+
+// Endpoint state changes reported by Windows, queued for the main thread.
+// Producers reserve a slot with a compare-exchange on WriteIndex, only while
+// the queue has room, and publish it by setting Ready; the main thread
+// consumes slots in order. A full queue drops the event before a slot is
+// reserved, so the consumer never waits on a slot nobody will fill.
+enum DeviceEventType {
+	DeviceEvent_StateChanged,
+	DeviceEvent_Added,
+	DeviceEvent_Removed,
+};
+
+struct DeviceEvent {
+	volatile LONG Ready;
+	DeviceEventType Type;
+	DWORD State;
+	LONGLONG Timestamp;
+	wchar_t Id[128];
+};
+
+#define MAX_DEVICE_EVENTS 256
+
+struct DeviceEventQueue {
+	DeviceEvent Events[MAX_DEVICE_EVENTS];
+	volatile LONG WriteIndex;
+	volatile LONG ReadIndex;
+	volatile LONG Enabled;
+	HANDLE Signal;
+};
+
+static DeviceEventQueue DeviceEvents;
+
+static void PushDeviceEvent(DeviceEventType type, LPCWSTR id, DWORD state)
+{
+	if (!DeviceEvents.Enabled)
+		return;
+
+	LONGLONG timestamp = GetTimestamp();
+
+	LONG write;
+	do
+	{
+		write = DeviceEvents.WriteIndex;
+
+		// The consumer is a full queue behind, drop the event
+		if (write - DeviceEvents.ReadIndex >= MAX_DEVICE_EVENTS)
+			return;
+	} while (InterlockedCompareExchange(&DeviceEvents.WriteIndex, write + 1, write) != write);
+
+	DeviceEvent* event = &DeviceEvents.Events[write & (MAX_DEVICE_EVENTS - 1)];
+
+	event->Type = type;
+	event->State = state;
+	event->Timestamp = timestamp;
+	wcsncpy(event->Id, id, 127);
+	event->Id[127] = L'\0';
+
+	InterlockedExchange(&event->Ready, 1);
+	SetEvent(DeviceEvents.Signal);
+}
+
+static bool PopDeviceEvent(DeviceEvent* result)
+{
+	DeviceEvent* event = &DeviceEvents.Events[DeviceEvents.ReadIndex & (MAX_DEVICE_EVENTS - 1)];
+	if (!event->Ready)
+		return false;
+
+	*result = *event;
+	InterlockedExchange(&event->Ready, 0);
+
+	// Frees the slot for producers once it is copied out
+	InterlockedIncrement(&DeviceEvents.ReadIndex);
+
+	return true;
+}
+
+struct EndpointNotificationClient : public IMMNotificationClient
+{
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object)
+	{
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(IMMNotificationClient))
+		{
+			*object = (IMMNotificationClient*)this;
+			return S_OK;
+		}
+
+		*object = NULL;
+		return E_NOINTERFACE;
+	}
+
+	// Lives for the whole process, so reference counting is a no-op
+	ULONG STDMETHODCALLTYPE AddRef() { return 1; }
+	ULONG STDMETHODCALLTYPE Release() { return 1; }
+
+	HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow dataFlow, ERole role, LPCWSTR id)
+	{
+		if (dataFlow == eRender || dataFlow == eCapture)
+			InterlockedOr(&Defaults.Stale, DEFAULT_ROLE_BIT(role, dataFlow));
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR id, DWORD state)
+	{
+		PushDeviceEvent(DeviceEvent_StateChanged, id, state);
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR id)
+	{
+		PushDeviceEvent(DeviceEvent_Added, id, 0);
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR id)
+	{
+		PushDeviceEvent(DeviceEvent_Removed, id, DEVICE_STATE_NOTPRESENT);
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR id, const PROPERTYKEY key) { return S_OK; }
+};
+
+static EndpointNotificationClient EndpointNotifications;
+
+static bool PlatformInitialize(void)
+{
+	// Multithreaded so session enumeration threads can share endpoint objects
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	if (FAILED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_INPROC_SERVER, __uuidof(IMMDeviceEnumerator), DeviceEnumerator.Put())))
+		return false;
+
+	DeviceEnumerator->RegisterEndpointNotificationCallback(&EndpointNotifications);
+
+	if (FAILED(CoCreateInstance(__uuidof(CPolicyConfigClient), NULL, CLSCTX_ALL, __uuidof(IPolicyConfig), PolicyConfig.Put())))
+		return false;
+
+	return true;
+}
+
+static void PlatformShutdown(void)
+{
+	PolicyConfig.Reset();
+	if (DeviceEnumerator)
+		DeviceEnumerator->UnregisterEndpointNotificationCallback(&EndpointNotifications);
+	DeviceEnumerator.Reset();
+	CoUninitialize();
+}
+
+// Only active endpoints have a volume to read
+static void ReadVolume(Device* device)
+{
+	PlatformDevice* platform = &device->Platform;
+	DeviceInfo* info = &device->Info;
+
+	info->HasVolume = false;
+	if (!platform->AudioEndpointVolume)
+		return;
+
+	LONGLONG start = GetTimestamp();
+	HRESULT scalarResult = platform->AudioEndpointVolume->GetMasterVolumeLevelScalar(&info->VolumeScalar);
+	RecordMetric(Metric_GetVolume, start, scalarResult);
+
+	start = GetTimestamp();
+	HRESULT levelResult = platform->AudioEndpointVolume->GetMasterVolumeLevel(&info->VolumeLevel);
+	RecordMetric(Metric_GetVolume, start, levelResult);
+
+	start = GetTimestamp();
+	HRESULT muteResult = platform->AudioEndpointVolume->GetMute(&info->IsMute);
+	RecordMetric(Metric_GetVolume, start, muteResult);
+
+	info->HasVolume = SUCCEEDED(scalarResult) && SUCCEEDED(levelResult) && SUCCEEDED(muteResult);
+}
+
+static void PopulateInfo(Device* device)
+{
+	PlatformDevice* platform = &device->Platform;
+	device->Info = {};
+
+	CoTaskMemString id;
+	platform->Device->GetId(id.Put());
+	device->Info.Id = InternString(id.Get());
+	platform->Device->GetState(&device->Info.State);
+
+	PropVariant varProperty;
+	platform->PropertyStore->GetValue(PKEY_Device_FriendlyName, varProperty.Put());
+	if (varProperty.Value.vt == VT_LPWSTR)
+		device->Info.Name = InternString(varProperty.Value.pwszVal);
+
+	platform->Endpoint->GetDataFlow(&device->Info.DataFlow);
+
+	if (device->Info.State == DEVICE_STATE_ACTIVE)
+		ReadVolume(device);
+}
+
+static UINT PlatformEnumerateDevices(Device* devices, UINT maxDevices)
+{
+	ComHandle<IMMDeviceCollection> deviceCollectionPtr;
+	DeviceEnumerator->EnumAudioEndpoints(eAll, DEVICE_STATE_ACTIVE | DEVICE_STATE_DISABLED | DEVICE_STATE_UNPLUGGED, deviceCollectionPtr.Put());
+
+	UINT count;
+	deviceCollectionPtr->GetCount(&count);
+
+	if (count > maxDevices)
+		return count;
+
+	ReserveStrings(count * 2, count * 96);
+
+	for (int i = 0; i < count; i++)
+	{
+		PlatformDevice* platform = &devices[i].Platform;
+
+		deviceCollectionPtr->Item(i, platform->Device.Put());
+		platform->Device->OpenPropertyStore(STGM_READ, platform->PropertyStore.Put());
+
+		LONGLONG start = GetTimestamp();
+		HRESULT result = platform->Device->Activate(__uuidof(IAudioEndpointVolume), CLSCTX_ALL, NULL, platform->AudioEndpointVolume.Put());
+		RecordMetric(Metric_Activate, start, result);
+
+		platform->Device->QueryInterface(__uuidof(IMMEndpoint), platform->Endpoint.Put());
+
+		PopulateInfo(&devices[i]);
+	}
+
+	return count;
+}
+
+static void PlatformReleaseDevice(Device* device)
+{
+	PlatformDevice* platform = &device->Platform;
+
+	platform->Endpoint.Reset();
+	platform->AudioEndpointVolume.Reset();
+	platform->PropertyStore.Reset();
+	platform->Device.Reset();
+}
+
+static StringId PlatformGetDefaultDevice(ERole role, EDataFlow dataFlow)
+{
+	ComHandle<IMMDevice> device;
+	CoTaskMemString id;
+
+	if (FAILED(DeviceEnumerator->GetDefaultAudioEndpoint(dataFlow, role, device.Put())))
+		return STRING_ID_NONE;
+	if (FAILED(device->GetId(id.Put())))
+		return STRING_ID_NONE;
+
+	return FindString(id.Get());
+}
+
+static HRESULT PlatformUpdateState(Device* device)
+{
+	PlatformDevice* platform = &device->Platform;
+
+	DWORD previous = device->Info.State;
+	HRESULT result = platform->Device->GetState(&device->Info.State);
+
+	// Endpoint volume can only be activated on an active endpoint
+	if (device->Info.State == DEVICE_STATE_ACTIVE && !platform->AudioEndpointVolume)
+	{
+		LONGLONG start = GetTimestamp();
+		HRESULT activated = platform->Device->Activate(__uuidof(IAudioEndpointVolume), CLSCTX_ALL, NULL, platform->AudioEndpointVolume.Put());
+		RecordMetric(Metric_Activate, start, activated);
+	}
+
+	// Volume and mute were never read while the endpoint was inactive
+	if (device->Info.State == DEVICE_STATE_ACTIVE && (previous != DEVICE_STATE_ACTIVE || !device->Info.HasVolume))
+		ReadVolume(device);
+	else if (device->Info.State != DEVICE_STATE_ACTIVE)
+		device->Info.HasVolume = false;
+
+	return result;
+}
+
+static HRESULT PlatformReadVolume(Device* device)
+{
+	ReadVolume(device);
+	return device->Info.HasVolume ? S_OK : E_FAIL;
+}
+
+static HRESULT PlatformSetVolumeScalar(Device* device, float volumeScalar)
+{
+	if (!device->Platform.AudioEndpointVolume)
+		return E_POINTER;
+	return device->Platform.AudioEndpointVolume->SetMasterVolumeLevelScalar(volumeScalar, &GUID_NULL);
+}
+
+static HRESULT PlatformSetVolumeLevel(Device* device, float volumeLevel)
+{
+	if (!device->Platform.AudioEndpointVolume)
+		return E_POINTER;
+	return device->Platform.AudioEndpointVolume->SetMasterVolumeLevel(volumeLevel, &GUID_NULL);
+}
+
+static HRESULT PlatformSetMute(Device* device, BOOL mute)
+{
+	if (!device->Platform.AudioEndpointVolume)
+		return E_POINTER;
+	return device->Platform.AudioEndpointVolume->SetMute(mute, &GUID_NULL);
+}
+
+static HRESULT PlatformSetVisibility(Device* device, bool visible)
+{
+	return PolicyConfig->SetEndpointVisibility(StringText(device->Info.Id), visible);
+}
+
+static HRESULT PlatformSetDefault(Device* device, ERole role)
+{
+	return PolicyConfig->SetDefaultEndpoint(StringText(device->Info.Id), role);
+}
+
+static BYTE BusFromEnumerator(const wchar_t* enumerator)
+{
+	if (wcscmp(enumerator, L"HDAUDIO") == 0 || wcscmp(enumerator, L"PCI") == 0)
+		return Bus_Internal;
+	if (wcscmp(enumerator, L"USB") == 0)
+		return Bus_Usb;
+	if (wcsncmp(enumerator, L"BTH", 3) == 0)
+		return Bus_Bluetooth;
+	if (wcscmp(enumerator, L"SWD") == 0 || wcscmp(enumerator, L"ROOT") == 0 || wcscmp(enumerator, L"MMDEVAPI") == 0)
+		return Bus_Virtual;
+
+	return Bus_Unknown;
+}
+
+static HRESULT PlatformReadDetails(Device* device, DeviceDetails* details)
+{
+	IPropertyStore* store = device->Platform.PropertyStore.Get();
+	if (store == NULL)
+		return E_POINTER;
+
+	details->FormFactor = UnknownFormFactor;
+	details->Bus = Bus_Unknown;
+
+	// The device format blob changes with the mix format, so it stamps the
+	// cached format without asking the audio service
+	UINT stamp = HashBytes(2166136261u, &device->Info.State, sizeof(device->Info.State));
+
+	PropVariant formFactor;
+	HRESULT result = store->GetValue(PKEY_AudioEndpoint_FormFactor, formFactor.Put());
+	if (SUCCEEDED(result) && formFactor.Value.vt == VT_UI4 && formFactor.Value.ulVal < EndpointFormFactor_enum_count)
+		details->FormFactor = (BYTE)formFactor.Value.ulVal;
+
+	PropVariant enumerator;
+	if (SUCCEEDED(store->GetValue(PKEY_Device_EnumeratorName, enumerator.Put())) && enumerator.Value.vt == VT_LPWSTR)
+		details->Bus = BusFromEnumerator(enumerator.Value.pwszVal);
+
+	PropVariant deviceFormat;
+	if (SUCCEEDED(store->GetValue(PKEY_AudioEngine_DeviceFormat, deviceFormat.Put())) && deviceFormat.Value.vt == VT_BLOB)
+		stamp = HashBytes(stamp, deviceFormat.Value.blob.pBlobData, deviceFormat.Value.blob.cbSize);
+
+	stamp = HashBytes(stamp, &details->FormFactor, sizeof(details->FormFactor));
+	details->Stamp = HashBytes(stamp, &details->Bus, sizeof(details->Bus));
+
+	return result;
+}
+
+// KSDATAFORMAT_SUBTYPE_IEEE_FLOAT starts with the plain format tag
+static bool IsFloatFormat(const WAVEFORMATEX* format)
+{
+	return format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT ||
+		(format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && ((const WAVEFORMATEXTENSIBLE*)format)->SubFormat.Data1 == WAVE_FORMAT_IEEE_FLOAT);
+}
+
+static HRESULT PlatformQueryFormat(Device* device, DeviceDetails* details)
+{
+	LPCWSTR id = StringText(device->Info.Id);
+
+	WAVEFORMATEX* format = NULL;
+	HRESULT result = PolicyConfig->GetMixFormat(id, &format);
+	if (FAILED(result))
+		return result;
+
+	details->SampleRate = format->nSamplesPerSec;
+	details->Channels = format->nChannels;
+	details->BitsPerSample = format->wBitsPerSample;
+
+	if (IsFloatFormat(format))
+		details->Flags |= DETAILS_FLOAT;
+
+	CoTaskMemFree(format);
+
+	return PolicyConfig->GetProcessingPeriod(id, FALSE, &details->DefaultPeriod, &details->MinimumPeriod);
+}
+
+static DWORD WINAPI LevelStreamThread(LPVOID parameter)
+{
+	LevelStream* stream = (LevelStream*)parameter;
+	PlatformLevelStream* platform = &stream->Platform;
+
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	// The shared mode buffer holds a second, so polling never overruns it
+	while (!platform->Stop)
+	{
+		Sleep(10);
+
+		UINT32 packetFrames = 0;
+		while (SUCCEEDED(platform->Capture->GetNextPacketSize(&packetFrames)) && packetFrames > 0)
+		{
+			BYTE* data;
+			UINT32 frames;
+			DWORD flags;
+			if (FAILED(platform->Capture->GetBuffer(&data, &frames, &flags, NULL, NULL)))
+				break;
+
+			bool silent = (flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0;
+			WriteRing(&stream->Ring, silent ? NULL : (float*)data, frames * stream->Channels);
+			platform->Capture->ReleaseBuffer(frames);
+		}
+	}
+
+	CoUninitialize();
+	return 0;
+}
+
+static bool PlatformStartLevelStream(Device* device, LevelStream* stream)
+{
+	PlatformLevelStream* platform = &stream->Platform;
+
+	LONGLONG start = GetTimestamp();
+	HRESULT result = device->Platform.Device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL, platform->Client.Put());
+	RecordMetric(Metric_Activate, start, result);
+	if (FAILED(result))
+		return false;
+
+	WAVEFORMATEX* format = NULL;
+	if (FAILED(platform->Client->GetMixFormat(&format)))
+	{
+		platform->Client.Reset();
+		return false;
+	}
+
+	stream->Channels = format->nChannels;
+	stream->SampleRate = format->nSamplesPerSec;
+
+	// Loopback taps the render mix before the endpoint volume and mute are
+	// applied, so a muted render endpoint still shows its signal returning.
+	// Capture endpoints deliver their signal after both.
+	stream->PostGain = device->Info.DataFlow == eCapture;
+
+	DWORD flags = device->Info.DataFlow == eRender ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0;
+	result = IsFloatFormat(format) ? platform->Client->Initialize(AUDCLNT_SHAREMODE_SHARED, flags, 10000000, 0, format, NULL) : E_FAIL;
+	CoTaskMemFree(format);
+
+	if (SUCCEEDED(result))
+		result = platform->Client->GetService(__uuidof(IAudioCaptureClient), platform->Capture.Put());
+	if (SUCCEEDED(result))
+		result = platform->Client->Start();
+	if (SUCCEEDED(result))
+	{
+		platform->Thread = CreateThread(NULL, 0, LevelStreamThread, stream, 0, NULL);
+		if (platform->Thread == NULL)
+			result = E_FAIL;
+	}
+
+	if (FAILED(result))
+	{
+		PlatformStopLevelStream(stream);
+		return false;
+	}
+
+	return true;
+}
+
+static void PlatformStopLevelStream(LevelStream* stream)
+{
+	PlatformLevelStream* platform = &stream->Platform;
+
+	if (platform->Thread)
+	{
+		InterlockedExchange(&platform->Stop, 1);
+		WaitForSingleObject(platform->Thread, INFINITE);
+		CloseHandle(platform->Thread);
+		platform->Thread = NULL;
+	}
+
+	if (platform->Client)
+		platform->Client->Stop();
+
+	platform->Capture.Reset();
+	platform->Client.Reset();
+}
+
+struct ConcurrentWork {
+	PlatformWork Work;
+	void* Context;
+	int Index;
+};
+
+static DWORD WINAPI ConcurrentWorkThread(LPVOID parameter)
+{
+	ConcurrentWork* work = (ConcurrentWork*)parameter;
+	work->Work(work->Index, work->Context);
+	return 0;
+}
+
+static void PlatformRunConcurrently(int count, PlatformWork work, void* context)
+{
+	// Endpoint objects live in the MTA, so any thread can call them
+	ConcurrentWork* items = (ConcurrentWork*)ArenaAlloc(count * sizeof(ConcurrentWork));
+	HANDLE* threads = (HANDLE*)ArenaAlloc(count * sizeof(HANDLE));
+
+	for (int i = 0; i < count; i++)
+	{
+		items[i].Work = work;
+		items[i].Context = context;
+		items[i].Index = i;
+
+		threads[i] = CreateThread(NULL, 0, ConcurrentWorkThread, &items[i], 0, NULL);
+
+		// Fall back to running on this thread
+		if (threads[i] == NULL)
+			work(i, context);
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		if (threads[i] == NULL)
+			continue;
+
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+
+	ArenaFree(threads);
+	ArenaFree(items);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Windows backend types: Core Audio endpoints plus the undocumented
+// IPolicyConfig for visibility and default devices.
+
+#include <mmdeviceapi.h>
+#include <endpointvolume.h>
+#include <audiopolicy.h>
+#include <audioclient.h>
+#include <tlhelp32.h>
+#include <functiondiscoverykeys_devpkey.h>
+#include "PolicyConfig.h"
+#include "audio_handles.h"
+
+#define CONFIG_PATH "D:\\CAudioDevices\\config.txt"
+#define DETAILS_PATH "D:\\CAudioDevices\\details.txt"
+
+struct PlatformDevice {
+	ComHandle<IMMDevice> Device;
+	ComHandle<IPropertyStore> PropertyStore;
+	ComHandle<IAudioEndpointVolume> AudioEndpointVolume;
+	ComHandle<IMMEndpoint> Endpoint;
+};
+
+struct PlatformLevelStream {
+	ComHandle<IAudioClient> Client;
+	ComHandle<IAudioCaptureClient> Capture;
+	HANDLE Thread;
+	volatile LONG Stop;
+};